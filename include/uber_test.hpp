@@ -1,7 +1,17 @@
 #pragma once
 
+#include <ut/options.hpp>
 #include <ut/test.hpp>
 #include <ut/suite.hpp>
+#include <ut/runner.hpp>
 #include <ut/registry.hpp>
 #include <ut/assertions.hpp>
+#include <ut/expect.hpp>
+#include <ut/buffers.hpp>
+#include <ut/snapshot.hpp>
 #include <ut/reporters/ostream_reporter.hpp>
+#include <ut/reporters/baseline_reporter.hpp>
+#include <ut/reporters/async_reporter.hpp>
+#include <ut/reporters/junit_reporter.hpp>
+#include <ut/reporters/json_reporter.hpp>
+#include <ut/reporters/tap_reporter.hpp>
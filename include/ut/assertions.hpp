@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdlib>
 #include <stdexcept>
 #include <string>
 #include <vector>
@@ -7,8 +8,18 @@
 #include <sstream>
 #include <iomanip>
 
-// backtrace
-#include <backward.hpp>
+#include <ut/stack.hpp>
+#include <ut/diff.hpp>
+
+// keeps the passing side of an assertion inline and the failing side out of
+// the way
+#if defined(__GNUC__)
+#define UT_LIKELY(x) __builtin_expect(!!(x), 1)
+#define UT_COLD __attribute__((cold, noinline))
+#else
+#define UT_LIKELY(x) (x)
+#define UT_COLD
+#endif
 
 namespace ut {
 
@@ -44,11 +55,28 @@ struct Formatter {
   const std::string sep = " ";
 };
 
+// where an assertion sits, as the literals __FILE__ and __func__, so an
+// assertion that passes never builds a string
+struct Site {
+  const char* file;
+  std::size_t line;
+  const char* func;
+};
+
 struct LocationInfo {
   const std::string file = "";
   const std::size_t line = 0;
   const std::string func = "";
 
+  LocationInfo() {}
+
+  LocationInfo(const std::string& file_, std::size_t line_, const std::string& func_)
+    : file(file_), line(line_), func(func_) {}
+
+  // once an assertion fails
+  LocationInfo(const Site& site)
+    : file(site.file), line(site.line), func(site.func) {}
+
   bool empty() {
     return file.empty() && func.empty() && line == 0;
   }
@@ -58,133 +86,147 @@ inline std::ostream& operator << (std::ostream& out, const LocationInfo& loc) {
   return out << "[" << loc.file << ":" << loc.line << "]:" << loc.func;
 }
 
-inline std::string stack() {
-  char* ptr;
-  std::size_t size = 0;
-  auto handle = open_memstream(&ptr, &size);
-
-  using namespace backward;
-  StackTrace st;
-  st.load_here(32);
-  Printer p;
-  p.print(st, handle);
-  fflush(handle);
-  return std::string(ptr, size);
-}
-
 struct Exception : public std::runtime_error {
   LocationInfo location;
-  std::string stack;
+  Stack stack;
 
+  // the assertion's own message, e.g. a Diff, followed by the context
+  // given to it
   template <typename... Args>
   Exception(std::string&& message, LocationInfo&& location, Args&&... args)
-    : std::runtime_error(ut::Formatter().concat(std::forward<Args>(args)...)),
+    : std::runtime_error(ut::Formatter().concat(trimmed(message), std::forward<Args>(args)...)),
       location(location),
-      stack(ut::stack()) {}
+      stack(Stack::capture()) {}
 
   Exception(std::string&& message, LocationInfo&& location)
     : std::runtime_error(message),
       location(location),
-      stack(ut::stack()) {}
+      stack(Stack::capture()) {}
 
   Exception(std::string&& message)
     : std::runtime_error(message),
-      stack(ut::stack()) {}
+      stack(Stack::capture()) {}
+
+  // the formatter leaves a separator behind every part
+  static std::string& trimmed(std::string& text) {
+    text.erase(text.find_last_not_of(' ') + 1);
+    return text;
+  }
 };
 
+// the failing side of every assertion below: formats the message and throws,
+// or without exceptions, see expect.hpp, reports it and aborts
+template <typename... Args>
+UT_COLD void fail(std::string&& message, Args&&... args) {
+#if defined(__cpp_exceptions) || defined(__EXCEPTIONS)
+  throw ut::Exception(std::move(message), std::forward<Args>(args)...);
+#else
+  ut::Exception e(std::move(message), std::forward<Args>(args)...);
+  std::cerr << e.what() << " " << e.location << "\n" << e.stack << std::flush;
+  std::abort();
+#endif
+}
+
+// long strings and containers are described by where they differ rather
+// than printed whole, see Diff
+template <typename T1, typename T2, typename... Args>
+UT_COLD void mismatch(const T1& t1, const char* relation, const T2& t2, Args&&... args) {
+  fail(Diff::describe(t1, relation, t2), std::forward<Args>(args)...);
+}
+
 template <typename... Args>
-void assert(bool value, Args&&... args) {
-  if (value)
+inline void assert(bool value, Args&&... args) {
+  if (UT_LIKELY(value))
     return;
 
-  throw ut::Exception(std::string("condition failed"), std::forward<Args>(args)...);
+  fail(std::string("condition failed"), std::forward<Args>(args)...);
 }
 
 template <typename... Args>
-void assert(bool value, const char* message) {
-  if (value)
+inline void assert(bool value, const char* message) {
+  if (UT_LIKELY(value))
     return;
 
-  throw ut::Exception(message);
+  fail(std::string(message));
 }
 
 template <typename T1, typename T2, typename... Args>
-void assert_eq(T1&& t1, T2&& t2, Args&&... args) {
-  if (t1 == t2)
+inline void assert_eq(const T1& t1, const T2& t2, Args&&... args) {
+  if (UT_LIKELY(t1 == t2))
     return;
 
-  throw ut::Exception(ut::Formatter().concat(t1, "!=", t2), std::forward<Args>(args)...);
+  mismatch(t1, "!=", t2, std::forward<Args>(args)...);
 }
 
 template <typename T1, typename T2, typename... Args>
-void assert_neq(T1&& t1, T2&& t2, Args&&... args) {
-  if (t1 != t2)
+inline void assert_neq(const T1& t1, const T2& t2, Args&&... args) {
+  if (UT_LIKELY(t1 != t2))
     return;
 
-  throw ut::Exception(ut::Formatter().concat(t1, "==", t2), std::forward<Args>(args)...);
+  mismatch(t1, "==", t2, std::forward<Args>(args)...);
 }
 
 template <typename T1, typename T2, typename... Args>
-void assert_lt(T1&& t1, T2&& t2, Args&&... args) {
-  if (t1 < t2)
+inline void assert_lt(const T1& t1, const T2& t2, Args&&... args) {
+  if (UT_LIKELY(t1 < t2))
     return;
 
-  throw ut::Exception(ut::Formatter().concat(t1, "!<", t2), std::forward<Args>(args)...);
+  mismatch(t1, "!<", t2, std::forward<Args>(args)...);
 }
 
 template <typename T1, typename T2, typename... Args>
-void assert_lte(T1&& t1, T2&& t2, Args&&... args) {
-  if (t1 <= t2)
+inline void assert_lte(const T1& t1, const T2& t2, Args&&... args) {
+  if (UT_LIKELY(t1 <= t2))
     return;
 
-  throw ut::Exception(ut::Formatter().concat(t1, "!<=", t2), std::forward<Args>(args)...);
+  mismatch(t1, "!<=", t2, std::forward<Args>(args)...);
 }
 
 template <typename T1, typename T2, typename... Args>
-void assert_gt(T1&& t1, T2&& t2, Args&&... args) {
-  if (t1 > t2)
+inline void assert_gt(const T1& t1, const T2& t2, Args&&... args) {
+  if (UT_LIKELY(t1 > t2))
     return;
 
-  throw ut::Exception(ut::Formatter().concat(t1, "!>", t2), std::forward<Args>(args)...);
+  mismatch(t1, "!>", t2, std::forward<Args>(args)...);
 }
 
 template <typename T1, typename T2, typename... Args>
-void assert_gte(T1&& t1, T2&& t2, Args&&... args) {
-  if (t1 >= t2)
+inline void assert_gte(const T1& t1, const T2& t2, Args&&... args) {
+  if (UT_LIKELY(t1 >= t2))
     return;
 
-  throw ut::Exception(ut::Formatter().concat(t1, "!>=", t2), std::forward<Args>(args)...);
+  mismatch(t1, "!>=", t2, std::forward<Args>(args)...);
 }
 
 }
 
 #define ut_assert(test, ...) \
-ut::assert(test, LocationInfo{__FILE__, __LINE__, __func__}, ##__VA_ARGS__); \
+ut::assert(test, ut::Site{__FILE__, __LINE__, __func__}, ##__VA_ARGS__); \
 
 #define ut_assert_throws(test, exception, ...) \
 try { \
   test; \
-  ut::assert(false, LocationInfo{__FILE__, __LINE__, __func__}, "Expected exception:", #exception, ##__VA_ARGS__); \
+  ut::assert(false, ut::Site{__FILE__, __LINE__, __func__}, "Expected exception:", #exception, ##__VA_ARGS__); \
 } \
 catch(exception& e) {} \
 catch(...) { \
-  ut::assert(false, LocationInfo{__FILE__, __LINE__, __func__}, "Expected exception:", #exception, ##__VA_ARGS__); \
+  ut::assert(false, ut::Site{__FILE__, __LINE__, __func__}, "Expected exception:", #exception, ##__VA_ARGS__); \
 } \
 
 #define ut_assert_eq(v1, v2, ...) \
-ut::assert_eq(v1, v2, LocationInfo{__FILE__, __LINE__, __func__}, ##__VA_ARGS__);
+ut::assert_eq(v1, v2, ut::Site{__FILE__, __LINE__, __func__}, ##__VA_ARGS__);
 
 #define ut_assert_neq(v1, v2, ...) \
-ut::assert_neq(v1, v2, LocationInfo{__FILE__, __LINE__, __func__}, ##__VA_ARGS__);
+ut::assert_neq(v1, v2, ut::Site{__FILE__, __LINE__, __func__}, ##__VA_ARGS__);
 
 #define ut_assert_lt(v1, v2, ...) \
-ut::assert_lt(v1, v2, LocationInfo{__FILE__, __LINE__, __func__}, ##__VA_ARGS__);
+ut::assert_lt(v1, v2, ut::Site{__FILE__, __LINE__, __func__}, ##__VA_ARGS__);
 
 #define ut_assert_lte(v1, v2, ...) \
-ut::assert_lte(v1, v2, LocationInfo{__FILE__, __LINE__, __func__}, ##__VA_ARGS__);
+ut::assert_lte(v1, v2, ut::Site{__FILE__, __LINE__, __func__}, ##__VA_ARGS__);
 
 #define ut_assert_gt(v1, v2, ...) \
-ut::assert_gt(v1, v2, LocationInfo{__FILE__, __LINE__, __func__}, ##__VA_ARGS__);
+ut::assert_gt(v1, v2, ut::Site{__FILE__, __LINE__, __func__}, ##__VA_ARGS__);
 
 #define ut_assert_gte(v1, v2, ...) \
-ut::assert_gte(v1, v2, LocationInfo{__FILE__, __LINE__, __func__}, ##__VA_ARGS__);
+ut::assert_gte(v1, v2, ut::Site{__FILE__, __LINE__, __func__}, ##__VA_ARGS__);
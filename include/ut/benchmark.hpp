@@ -0,0 +1,162 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+#include <ut/timer.hpp>
+
+namespace ut {
+
+// keeps the compiler from discarding a value the benchmark computed
+template <typename T>
+inline void do_not_optimize(const T& value) {
+#if defined(__clang__)
+  asm volatile("" : : "r,m"(value) : "memory");
+#elif defined(__GNUC__)
+  asm volatile("" : : "m,r"(value) : "memory");
+#else
+  static volatile const void* sink;
+  sink = &value;
+#endif
+}
+
+namespace detail {
+
+// gcc can miscompile a read-write operand offered both as memory and as a
+// register, handing the asm one location and reading the value back from
+// the other, so scalars get a register and everything else memory; a
+// small aggregate such as char[3] has no register form at all
+template <typename T>
+inline void do_not_optimize(T& value, std::true_type) {
+  asm volatile("" : "+r"(value) : : "memory");
+}
+
+template <typename T>
+inline void do_not_optimize(T& value, std::false_type) {
+  asm volatile("" : "+m"(value) : : "memory");
+}
+
+template <typename T>
+struct fits_register : std::integral_constant<bool, std::is_arithmetic<T>::value || std::is_pointer<T>::value || std::is_enum<T>::value> {};
+
+}
+
+template <typename T>
+inline void do_not_optimize(T& value) {
+#if defined(__clang__)
+  asm volatile("" : "+r,m"(value) : : "memory");
+#elif defined(__GNUC__)
+  detail::do_not_optimize(value, detail::fits_register<T>());
+#else
+  static volatile void* sink;
+  sink = &value;
+#endif
+}
+
+// forces pending writes to memory, so stores can't be elided or sunk out of the loop
+inline void clobber_memory() {
+#if defined(__GNUC__) || defined(__clang__)
+  asm volatile("" : : : "memory");
+#else
+  std::atomic_signal_fence(std::memory_order_acq_rel);
+#endif
+}
+
+// per iteration timings of a benchmark, in nanoseconds
+struct Statistics {
+  std::size_t samples = 0;
+  std::size_t iterations = 0;
+  double min = 0;
+  double median = 0;
+  double mean = 0;
+  double stddev = 0;
+  double p99 = 0;
+
+  // iterations per second
+  double throughput() const {
+    return (mean > 0) ? 1e9 / mean : 0;
+  }
+
+  static Statistics of(std::vector<double> timings, std::size_t iterations) {
+    Statistics s;
+    s.samples = timings.size();
+    s.iterations = iterations;
+    if (timings.empty())
+      return s;
+
+    std::sort(timings.begin(), timings.end());
+    auto n = timings.size();
+    s.min = timings.front();
+    s.median = (n % 2) ? timings[n / 2] : (timings[n / 2 - 1] + timings[n / 2]) / 2;
+    s.p99 = timings[std::min(n - 1, static_cast<std::size_t>(std::ceil(0.99 * n)) - 1)];
+
+    double sum = 0;
+    for (auto t : timings)
+      sum += t;
+    s.mean = sum / n;
+
+    double squares = 0;
+    for (auto t : timings)
+      squares += (t - s.mean) * (t - s.mean);
+    s.stddev = (n > 1) ? std::sqrt(squares / (n - 1)) : 0;
+    return s;
+  }
+};
+
+// runs a body repeatedly: first for a warmup period, then in samples whose
+// iteration count is calibrated so that all samples fill the target time
+struct Benchmark {
+  struct Settings {
+    double warmup = 0.1;
+    double time = 0.5;
+    std::size_t samples = 50;
+  };
+
+  static Settings& settings() {
+    static Settings s;
+    return s;
+  }
+
+  template <typename Fn>
+  static double measure(const Fn& fn, std::size_t iterations) {
+    timer t;
+    t.start();
+    for (std::size_t i = 0; i < iterations; ++i)
+      fn();
+    t.stop();
+    return t.nanoseconds();
+  }
+
+  template <typename Fn>
+  static Statistics run(const Fn& fn) {
+    const auto& config = settings();
+    auto samples = std::max<std::size_t>(config.samples, 1);
+
+    // doubling batches both warm up caches and estimate the cost of an iteration
+    std::size_t batch = 1;
+    double elapsed = 0;
+    double per_iteration = 0;
+    do {
+      auto t = measure(fn, batch);
+      elapsed += t;
+      per_iteration = t / batch;
+      if (t < 1e6)
+        batch *= 2;
+    } while (elapsed < config.warmup * 1e9);
+
+    auto target = config.time * 1e9 / samples;
+    auto iterations = std::max<std::size_t>(1, static_cast<std::size_t>(target / std::max(per_iteration, 1.0)));
+
+    std::vector<double> timings;
+    timings.reserve(samples);
+    for (std::size_t i = 0; i < samples; ++i)
+      timings.push_back(measure(fn, iterations) / iterations);
+    return Statistics::of(std::move(timings), iterations);
+  }
+};
+
+}
@@ -0,0 +1,393 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <type_traits>
+
+#if defined(__SSE2__) || defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+#include <ut/assertions.hpp>
+
+namespace ut {
+
+// how far apart two floating point values may be and still count as equal:
+// within any one of the bounds is enough; NaN only matches NaN
+struct Tolerance {
+  double absolute = 0;
+  // of the larger magnitude of the two
+  double relative = 0;
+  // representable values in between
+  std::uint64_t ulps = 0;
+};
+
+// a Tolerance that can go through a macro argument, which braces cannot
+inline Tolerance within(double absolute, double relative = 0, std::uint64_t ulps = 0) {
+  Tolerance t;
+  t.absolute = absolute;
+  t.relative = relative;
+  t.ulps = ulps;
+  return t;
+}
+
+// a contiguous run of count values starting at p, for buffers that are not
+// containers
+template <typename T>
+struct View {
+  const T* p;
+  std::size_t count;
+
+  const T* data() const {
+    return p;
+  }
+
+  std::size_t size() const {
+    return count;
+  }
+};
+
+template <typename T>
+View<T> view(const T* p, std::size_t count) {
+  return {p, count};
+}
+
+// scans for the first difference in bulk, a vector register at a time where
+// the target has them, so a passing comparison of a large buffer runs at
+// about memory bandwidth
+struct Buffers {
+  template <typename R>
+  static auto data(const R& r) -> decltype(r.data()) {
+    return r.data();
+  }
+
+  template <typename T, std::size_t N>
+  static const T* data(const T (&a)[N]) {
+    return a;
+  }
+
+  template <typename R>
+  static std::size_t size(const R& r) {
+    return r.size();
+  }
+
+  template <typename T, std::size_t N>
+  static std::size_t size(const T (&)[N]) {
+    return N;
+  }
+
+  // offset of the first byte at or after from that differs, or size
+  static std::size_t mismatch(const unsigned char* a, const unsigned char* b, std::size_t size, std::size_t from = 0) {
+    auto i = from;
+#if defined(__AVX2__)
+    // two registers per step, then one to find which differed
+    for (; i + 64 <= size; i += 64) {
+      auto e0 = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i)), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i)));
+      auto e1 = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i + 32)), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i + 32)));
+      if (_mm256_movemask_epi8(_mm256_and_si256(e0, e1)) != -1)
+        break;
+    }
+    for (; i + 32 <= size; i += 32) {
+      auto e = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i)), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i)));
+      auto mask = static_cast<unsigned>(_mm256_movemask_epi8(e));
+      if (mask != 0xffffffffu)
+        return i + __builtin_ctz(~mask);
+    }
+#elif defined(__SSE2__)
+    for (; i + 32 <= size; i += 32) {
+      auto e0 = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i)));
+      auto e1 = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i + 16)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i + 16)));
+      if (_mm_movemask_epi8(_mm_and_si128(e0, e1)) != 0xffff)
+        break;
+    }
+    for (; i + 16 <= size; i += 16) {
+      auto e = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i)));
+      auto mask = static_cast<unsigned>(_mm_movemask_epi8(e));
+      if (mask != 0xffffu)
+        return i + __builtin_ctz(~mask);
+    }
+#else
+    // word at a time
+    for (; i + sizeof(std::uint64_t) <= size; i += sizeof(std::uint64_t)) {
+      std::uint64_t x, y;
+      std::memcpy(&x, a + i, sizeof(x));
+      std::memcpy(&y, b + i, sizeof(y));
+      if (x != y)
+        break;
+    }
+#endif
+    for (; i < size; ++i)
+      if (a[i] != b[i])
+        return i;
+    return size;
+  }
+
+  // index of the first element at or after from that differs in any byte,
+  // or count
+  template <typename T>
+  static std::size_t mismatch(const T* a, const T* b, std::size_t count, std::size_t from = 0) {
+    auto bytes = mismatch(reinterpret_cast<const unsigned char*>(a), reinterpret_cast<const unsigned char*>(b), count * sizeof(T), from * sizeof(T));
+    return bytes / sizeof(T);
+  }
+
+  template <typename T>
+  static bool near(T a, T b, const Tolerance& t) {
+    if (a == b)
+      return true;
+    if (std::isnan(a) || std::isnan(b))
+      return std::isnan(a) && std::isnan(b);
+    // no tolerance brings a finite value near an infinity, nor -inf near inf
+    if (std::isinf(a) || std::isinf(b))
+      return false;
+    T difference = std::fabs(a - b);
+    if (difference <= static_cast<T>(t.absolute) || difference <= static_cast<T>(t.relative) * std::max(std::fabs(a), std::fabs(b)))
+      return true;
+    return ulps(a, b) <= t.ulps;
+  }
+
+  // representable values from a to b, counting across zero
+  static std::uint64_t ulps(float a, float b) {
+    std::uint32_t x, y;
+    std::memcpy(&x, &a, sizeof(x));
+    std::memcpy(&y, &b, sizeof(y));
+    x = (x >> 31) ? ~x : (x | 0x80000000u);
+    y = (y >> 31) ? ~y : (y | 0x80000000u);
+    return (x > y) ? x - y : y - x;
+  }
+
+  static std::uint64_t ulps(double a, double b) {
+    std::uint64_t x, y;
+    std::memcpy(&x, &a, sizeof(x));
+    std::memcpy(&y, &b, sizeof(y));
+    x = (x >> 63) ? ~x : (x | 0x8000000000000000u);
+    y = (y >> 63) ? ~y : (y | 0x8000000000000000u);
+    return (x > y) ? x - y : y - x;
+  }
+
+  static std::uint64_t ulps(long double a, long double b) {
+    return (a == b) ? 0 : std::numeric_limits<std::uint64_t>::max();
+  }
+
+  // index of the first element at or after from that is not near, or count;
+  // registers settle equal, absolutely and relatively close lanes, anything
+  // else, NaN and ULP distances included, is decided by near()
+  template <typename T>
+  static std::size_t far(const T* a, const T* b, std::size_t count, const Tolerance& t, std::size_t from = 0) {
+    auto i = from;
+    while (i < count) {
+      i = lanes(a, b, count, t, i);
+      // at least a register's worth, then back to the registers
+      for (auto end = std::min(count, i + 8); i < end; ++i)
+        if (!near(a[i], b[i], t))
+          return i;
+    }
+    return count;
+  }
+
+  // leaves off at the first register holding a lane it could not settle
+  template <typename T>
+  static std::size_t lanes(const T*, const T*, std::size_t, const Tolerance&, std::size_t from) {
+    return from;
+  }
+
+#if defined(__AVX__)
+  static std::size_t lanes(const float* a, const float* b, std::size_t count, const Tolerance& t, std::size_t from) {
+    const auto sign = _mm256_set1_ps(-0.0f);
+    const auto absolute = _mm256_set1_ps(static_cast<float>(t.absolute));
+    const auto relative = _mm256_set1_ps(static_cast<float>(t.relative));
+    const auto infinity = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+    auto i = from;
+    for (; i + 8 <= count; i += 8) {
+      auto x = _mm256_loadu_ps(a + i), y = _mm256_loadu_ps(b + i);
+      auto difference = _mm256_andnot_ps(sign, _mm256_sub_ps(x, y));
+      auto largest = _mm256_max_ps(_mm256_andnot_ps(sign, x), _mm256_andnot_ps(sign, y));
+      // an infinite difference would pass against an infinite bound
+      auto close = _mm256_or_ps(_mm256_cmp_ps(difference, absolute, _CMP_LE_OQ), _mm256_cmp_ps(difference, _mm256_mul_ps(relative, largest), _CMP_LE_OQ));
+      auto ok = _mm256_or_ps(_mm256_cmp_ps(x, y, _CMP_EQ_OQ), _mm256_and_ps(_mm256_cmp_ps(difference, infinity, _CMP_LT_OQ), close));
+      if (_mm256_movemask_ps(ok) != 0xff)
+        break;
+    }
+    return i;
+  }
+
+  static std::size_t lanes(const double* a, const double* b, std::size_t count, const Tolerance& t, std::size_t from) {
+    const auto sign = _mm256_set1_pd(-0.0);
+    const auto absolute = _mm256_set1_pd(t.absolute);
+    const auto relative = _mm256_set1_pd(t.relative);
+    const auto infinity = _mm256_set1_pd(std::numeric_limits<double>::infinity());
+    auto i = from;
+    for (; i + 4 <= count; i += 4) {
+      auto x = _mm256_loadu_pd(a + i), y = _mm256_loadu_pd(b + i);
+      auto difference = _mm256_andnot_pd(sign, _mm256_sub_pd(x, y));
+      auto largest = _mm256_max_pd(_mm256_andnot_pd(sign, x), _mm256_andnot_pd(sign, y));
+      auto close = _mm256_or_pd(_mm256_cmp_pd(difference, absolute, _CMP_LE_OQ), _mm256_cmp_pd(difference, _mm256_mul_pd(relative, largest), _CMP_LE_OQ));
+      auto ok = _mm256_or_pd(_mm256_cmp_pd(x, y, _CMP_EQ_OQ), _mm256_and_pd(_mm256_cmp_pd(difference, infinity, _CMP_LT_OQ), close));
+      if (_mm256_movemask_pd(ok) != 0xf)
+        break;
+    }
+    return i;
+  }
+#elif defined(__SSE2__)
+  static std::size_t lanes(const float* a, const float* b, std::size_t count, const Tolerance& t, std::size_t from) {
+    const auto sign = _mm_set1_ps(-0.0f);
+    const auto absolute = _mm_set1_ps(static_cast<float>(t.absolute));
+    const auto relative = _mm_set1_ps(static_cast<float>(t.relative));
+    const auto infinity = _mm_set1_ps(std::numeric_limits<float>::infinity());
+    auto i = from;
+    for (; i + 4 <= count; i += 4) {
+      auto x = _mm_loadu_ps(a + i), y = _mm_loadu_ps(b + i);
+      auto difference = _mm_andnot_ps(sign, _mm_sub_ps(x, y));
+      auto largest = _mm_max_ps(_mm_andnot_ps(sign, x), _mm_andnot_ps(sign, y));
+      // an infinite difference would pass against an infinite bound
+      auto close = _mm_or_ps(_mm_cmple_ps(difference, absolute), _mm_cmple_ps(difference, _mm_mul_ps(relative, largest)));
+      auto ok = _mm_or_ps(_mm_cmpeq_ps(x, y), _mm_and_ps(_mm_cmplt_ps(difference, infinity), close));
+      if (_mm_movemask_ps(ok) != 0xf)
+        break;
+    }
+    return i;
+  }
+
+  static std::size_t lanes(const double* a, const double* b, std::size_t count, const Tolerance& t, std::size_t from) {
+    const auto sign = _mm_set1_pd(-0.0);
+    const auto absolute = _mm_set1_pd(t.absolute);
+    const auto relative = _mm_set1_pd(t.relative);
+    const auto infinity = _mm_set1_pd(std::numeric_limits<double>::infinity());
+    auto i = from;
+    for (; i + 2 <= count; i += 2) {
+      auto x = _mm_loadu_pd(a + i), y = _mm_loadu_pd(b + i);
+      auto difference = _mm_andnot_pd(sign, _mm_sub_pd(x, y));
+      auto largest = _mm_max_pd(_mm_andnot_pd(sign, x), _mm_andnot_pd(sign, y));
+      auto close = _mm_or_pd(_mm_cmple_pd(difference, absolute), _mm_cmple_pd(difference, _mm_mul_pd(relative, largest)));
+      auto ok = _mm_or_pd(_mm_cmpeq_pd(x, y), _mm_and_pd(_mm_cmplt_pd(difference, infinity), close));
+      if (_mm_movemask_pd(ok) != 0x3)
+        break;
+    }
+    return i;
+  }
+#endif
+
+  template <typename T>
+  static std::string value(const T& v) {
+    return Diff::show(v);
+  }
+
+  static std::string value(unsigned char v) {
+    std::stringstream out;
+    out << "0x" << std::hex << std::setw(2) << std::setfill('0') << static_cast<unsigned>(v);
+    return out.str();
+  }
+
+  static std::string value(signed char v) {
+    return value(static_cast<unsigned char>(v));
+  }
+
+  static std::string value(char v) {
+    return value(static_cast<unsigned char>(v));
+  }
+
+  template <typename T, typename std::enable_if<std::is_floating_point<T>::value, int>::type = 0>
+  static std::string real(T v) {
+    std::stringstream out;
+    out << std::setprecision(std::numeric_limits<T>::max_digits10) << v;
+    return out.str();
+  }
+};
+
+// the first difference is known; counts the rest and describes both
+template <typename T, typename... Args>
+UT_COLD void buffers_differ(const T* a, const T* b, std::size_t count, std::size_t first, Args&&... args) {
+  std::size_t differences = 0;
+  for (auto i = first; i < count; i = Buffers::mismatch(a, b, count, i + 1))
+    ++differences;
+
+  std::stringstream out;
+  out << "buffers differ at [" << first << "]: " << Buffers::value(a[first]) << " != " << Buffers::value(b[first]) << ", " << differences << " of " << count << " elements differ";
+  fail(out.str(), std::forward<Args>(args)...);
+}
+
+template <typename T, typename... Args>
+UT_COLD void buffers_far(const T* a, const T* b, std::size_t count, std::size_t first, const Tolerance& t, Args&&... args) {
+  std::size_t differences = 0;
+  for (auto i = first; i < count; i = Buffers::far(a, b, count, t, i + 1))
+    ++differences;
+
+  std::stringstream out;
+  out << "buffers differ at [" << first << "]: " << Buffers::real(a[first]) << " !~ " << Buffers::real(b[first])
+      << " (difference " << Buffers::real(std::fabs(a[first] - b[first])) << ", " << Buffers::ulps(a[first], b[first]) << " ulps), "
+      << differences << " of " << count << " elements beyond absolute " << t.absolute << ", relative " << t.relative << ", " << t.ulps << " ulps";
+  fail(out.str(), std::forward<Args>(args)...);
+}
+
+template <typename... Args>
+UT_COLD void buffer_sizes_differ(std::size_t n1, std::size_t n2, Args&&... args) {
+  fail(ut::Formatter().concat("buffer sizes differ:", n1, "!=", n2), std::forward<Args>(args)...);
+}
+
+// byte for byte equality of two contiguous buffers of size bytes
+template <typename... Args>
+inline void assert_bytes_eq(const void* p1, const void* p2, std::size_t size, Args&&... args) {
+  auto a = static_cast<const unsigned char*>(p1), b = static_cast<const unsigned char*>(p2);
+  auto first = Buffers::mismatch(a, b, size);
+  if (UT_LIKELY(first == size))
+    return;
+
+  buffers_differ(a, b, size, first, std::forward<Args>(args)...);
+}
+
+// element for element equality of two contiguous ranges, e.g. std::vector,
+// std::array, arrays or View, compared as bytes, so the element type must
+// not have padding; 0.0 and -0.0 differ, the same NaN does not
+template <typename R1, typename R2, typename... Args>
+inline void assert_buffer_eq(const R1& r1, const R2& r2, Args&&... args) {
+  auto a = Buffers::data(r1);
+  auto b = Buffers::data(r2);
+  typedef typename std::remove_const<typename std::remove_pointer<decltype(a)>::type>::type T;
+  static_assert(std::is_same<T, typename std::remove_const<typename std::remove_pointer<decltype(b)>::type>::type>::value, "buffers must hold the same type");
+  static_assert(std::is_trivially_copyable<T>::value, "buffers are compared as bytes");
+
+  auto n1 = Buffers::size(r1), n2 = Buffers::size(r2);
+  if (n1 != n2)
+    buffer_sizes_differ(n1, n2, std::forward<Args>(args)...);
+  auto first = Buffers::mismatch(a, b, n1);
+  if (UT_LIKELY(first == n1))
+    return;
+
+  buffers_differ(a, b, n1, first, std::forward<Args>(args)...);
+}
+
+// element for element closeness of two contiguous ranges of float or double
+template <typename R1, typename R2, typename... Args>
+inline void assert_near(const R1& r1, const R2& r2, const Tolerance& tolerance, Args&&... args) {
+  auto a = Buffers::data(r1);
+  auto b = Buffers::data(r2);
+  typedef typename std::remove_const<typename std::remove_pointer<decltype(a)>::type>::type T;
+  static_assert(std::is_same<T, typename std::remove_const<typename std::remove_pointer<decltype(b)>::type>::type>::value, "buffers must hold the same type");
+  static_assert(std::is_floating_point<T>::value, "assert_near compares floating point buffers");
+
+  auto n1 = Buffers::size(r1), n2 = Buffers::size(r2);
+  if (n1 != n2)
+    buffer_sizes_differ(n1, n2, std::forward<Args>(args)...);
+  auto first = Buffers::far(a, b, n1, tolerance);
+  if (UT_LIKELY(first == n1))
+    return;
+
+  buffers_far(a, b, n1, first, tolerance, std::forward<Args>(args)...);
+}
+
+}
+
+#define ut_assert_bytes_eq(p1, p2, size, ...) \
+ut::assert_bytes_eq(p1, p2, size, ut::Site{__FILE__, __LINE__, __func__}, ##__VA_ARGS__)
+
+#define ut_assert_buffer_eq(v1, v2, ...) \
+ut::assert_buffer_eq(v1, v2, ut::Site{__FILE__, __LINE__, __func__}, ##__VA_ARGS__)
+
+#define ut_assert_near(v1, v2, tolerance, ...) \
+ut::assert_near(v1, v2, tolerance, ut::Site{__FILE__, __LINE__, __func__}, ##__VA_ARGS__)
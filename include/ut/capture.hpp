@@ -0,0 +1,233 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+namespace ut {
+
+// redirects the stdout and stderr file descriptors while a test runs, so
+// output from printf, write(2), C libraries and child processes is captured
+// along with std::cout; a reader thread drains the pipes into bounded
+// buffers, so a chatty test neither blocks on a full pipe nor grows memory
+// without bound
+//
+// descriptors are process wide, so capture is only enabled while tests run
+// one at a time: serially, or inside isolated workers
+struct Capture {
+  // keeps the first and last limit / 2 bytes of a stream
+  struct Buffer {
+    std::size_t limit = 0;
+    std::string head;
+    std::vector<char> tail;
+    // bytes that went past the head
+    std::size_t written = 0;
+
+    void reset(std::size_t limit_) {
+      limit = limit_;
+      head.clear();
+      tail.assign(limit - limit / 2, '\0');
+      written = 0;
+    }
+
+    void append(const char* data, std::size_t size) {
+      auto n = std::min(size, limit / 2 - head.size());
+      head.append(data, n);
+      data += n;
+      size -= n;
+
+      auto capacity = tail.size();
+      if (capacity == 0) {
+        written += size;
+        return;
+      }
+      // only the last capacity bytes of a large write survive anyway
+      if (size > capacity) {
+        written += size - capacity;
+        data += size - capacity;
+        size = capacity;
+      }
+      while (size > 0) {
+        auto pos = written % capacity;
+        auto chunk = std::min(size, capacity - pos);
+        std::memcpy(&tail[pos], data, chunk);
+        written += chunk;
+        data += chunk;
+        size -= chunk;
+      }
+    }
+
+    std::string str() const {
+      auto s = head;
+      auto capacity = tail.size();
+      if (written <= capacity) {
+        s.append(tail.data(), written);
+        return s;
+      }
+      s += "\n[... " + std::to_string(written - capacity) + " bytes omitted ...]\n";
+      auto pos = written % capacity;
+      s.append(tail.data() + pos, capacity - pos);
+      s.append(tail.data(), pos);
+      return s;
+    }
+  };
+
+  // leaked, so the detached reader never outlives it at exit
+  static Capture& instance() {
+    static Capture* capture = new Capture();
+    return *capture;
+  }
+
+  static bool& enabled() {
+    static bool value = false;
+    return value;
+  }
+
+  // stdio allocates a stream's buffer on its first write, which would
+  // otherwise land in, and leak from, the first test that prints
+  static void warm() {
+    static bool warmed = false;
+    if (warmed)
+      return;
+    warmed = true;
+    flush();
+    int null = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    if (null < 0)
+      return;
+    int saved[2] = {dup(STDOUT_FILENO), dup(STDERR_FILENO)};
+    dup2(null, STDOUT_FILENO);
+    dup2(null, STDERR_FILENO);
+    std::cout << ' ';
+    std::cerr << ' ';
+    flush();
+    dup2(saved[0], STDOUT_FILENO);
+    dup2(saved[1], STDERR_FILENO);
+    close(saved[0]);
+    close(saved[1]);
+    close(null);
+  }
+
+  // bytes kept per stream and test
+  static std::size_t& limit() {
+    static std::size_t value = 65536;
+    return value;
+  }
+
+  void begin() {
+    start();
+    flush();
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      for (auto& b : buffers)
+        b.reset(limit());
+    }
+    for (int i = 0; i < 2; ++i) {
+      saved[i] = dup(streams[i]);
+      dup2(pipes[i][1], streams[i]);
+    }
+  }
+
+  void end(std::string& out, std::string& err) {
+    flush();
+    for (int i = 0; i < 2; ++i) {
+      dup2(saved[i], streams[i]);
+      close(saved[i]);
+    }
+
+    // everything the test wrote is in the pipes by now; wait for the reader
+    // to get that far, and no further, as a child left behind holding the
+    // pipes may go on writing
+    std::size_t target[2];
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      for (int i = 0; i < 2; ++i)
+        target[i] = drained[i] + pending(i);
+    }
+    while (true) {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (drained[0] >= target[0] && drained[1] >= target[1]) {
+          out = buffers[0].str();
+          err = buffers[1].str();
+          return;
+        }
+      }
+      std::this_thread::yield();
+    }
+  }
+
+private:
+  const int streams[2] = {STDOUT_FILENO, STDERR_FILENO};
+  int pipes[2][2] = {{-1, -1}, {-1, -1}};
+  int saved[2] = {-1, -1};
+  Buffer buffers[2];
+  // bytes read from each pipe so far
+  std::size_t drained[2] = {0, 0};
+  std::mutex mutex;
+  pid_t owner = 0;
+
+  static void flush() {
+    std::cout.flush();
+    std::cerr.flush();
+    fflush(stdout);
+    fflush(stderr);
+  }
+
+  int pending(int i) const {
+    int n = 0;
+    ioctl(pipes[i][0], FIONREAD, &n);
+    return n;
+  }
+
+  // the pipes and reader are created on first use, and again in a forked
+  // worker, which inherits the pipes but not the thread draining them
+  void start() {
+    if (owner == getpid())
+      return;
+    for (auto& p : pipes) {
+      if (p[0] >= 0) {
+        close(p[0]);
+        close(p[1]);
+      }
+      if (pipe(p) != 0)
+        throw std::runtime_error("unable to create capture pipes");
+      fcntl(p[0], F_SETFL, fcntl(p[0], F_GETFL) | O_NONBLOCK);
+      fcntl(p[0], F_SETFD, FD_CLOEXEC);
+      fcntl(p[1], F_SETFD, FD_CLOEXEC);
+    }
+    owner = getpid();
+    std::thread([this]() { drain(pipes[0][0], pipes[1][0]); }).detach();
+  }
+
+  // reads under the lock, so end() seeing empty pipes means nothing is in flight
+  void drain(int out, int err) {
+    pollfd fds[2] = {{out, POLLIN, 0}, {err, POLLIN, 0}};
+    char chunk[65536];
+    while (true) {
+      if (poll(fds, 2, -1) < 0 && errno != EINTR)
+        return;
+      std::lock_guard<std::mutex> lock(mutex);
+      for (int i = 0; i < 2; ++i) {
+        ssize_t n;
+        while ((n = ::read(fds[i].fd, chunk, sizeof(chunk))) > 0) {
+          buffers[i].append(chunk, n);
+          drained[i] += n;
+        }
+      }
+    }
+  }
+};
+
+}
@@ -0,0 +1,608 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace ut {
+
+namespace detail {
+
+template <typename...>
+struct voider {
+  typedef void type;
+};
+
+template <typename T, typename = void>
+struct is_streamable : std::false_type {};
+
+template <typename T>
+struct is_streamable<T, typename voider<decltype(std::declval<std::ostream&>() << std::declval<const T&>())>::type> : std::true_type {};
+
+template <typename T, typename = void>
+struct is_range : std::false_type {};
+
+template <typename T>
+struct is_range<T, typename voider<decltype(std::begin(std::declval<const T&>())), decltype(std::end(std::declval<const T&>()))>::type> : std::true_type {};
+
+template <typename T, typename = void>
+struct is_keyed : std::false_type {};
+
+template <typename T>
+struct is_keyed<T, typename voider<typename T::key_type>::type> : std::true_type {};
+
+template <typename T, typename = void>
+struct is_mapped : std::false_type {};
+
+template <typename T>
+struct is_mapped<T, typename voider<typename T::mapped_type>::type> : std::true_type {};
+
+template <typename T>
+struct is_string : std::false_type {};
+
+template <typename Traits, typename Alloc>
+struct is_string<std::basic_string<char, Traits, Alloc>> : std::true_type {};
+
+// std::string, or what converts to one next to it
+template <typename T>
+struct is_text : std::integral_constant<bool, is_string<T>::value || std::is_same<typename std::decay<T>::type, const char*>::value || std::is_same<typename std::decay<T>::type, char*>::value> {};
+
+template <typename T>
+struct is_sequence : std::integral_constant<bool, is_range<T>::value && !is_string<T>::value && !std::is_array<T>::value> {};
+
+template <typename T>
+struct is_pair : std::false_type {};
+
+template <typename A, typename B>
+struct is_pair<std::pair<A, B>> : std::true_type {};
+
+template <typename T>
+struct is_tuple : std::false_type {};
+
+template <typename... T>
+struct is_tuple<std::tuple<T...>> : std::true_type {};
+
+template <std::size_t N>
+struct priority : priority<N - 1> {};
+
+template <>
+struct priority<0> {};
+
+}
+
+// explains why two values compare the way they do without streaming them
+// whole: scalars and short strings print as before, longer strings and
+// containers show where they first differ and a bounded diff around it,
+// Myers' for sequences and strings of lines, key by key for maps and sets
+struct Diff {
+  struct Limits {
+    // elements, or lines, diffed past the common prefix
+    std::size_t window = 1024;
+    // differences within the window the diff looks for before giving up
+    std::size_t edits = 64;
+    // lines of output, and characters per value shown
+    std::size_t lines = 32;
+    std::size_t width = 80;
+    // strings up to this long without a newline print whole
+    std::size_t small = 64;
+    // equal elements shown around each difference
+    std::size_t context = 2;
+  };
+
+  static Limits& limits() {
+    static Limits value;
+    return value;
+  }
+
+  template <typename T1, typename T2>
+  static std::string describe(const T1& t1, const char* relation, const T2& t2) {
+    return describe(t1, relation, t2, detail::priority<3>());
+  }
+
+  // a value, clipped to the configured width
+  template <typename T>
+  static std::string show(const T& value) {
+    return clip(render(value, detail::priority<4>()));
+  }
+
+private:
+  enum class Op : char {
+    Keep = ' ',
+    Remove = '-',
+    Insert = '+'
+  };
+
+  struct Edit {
+    Op op;
+    std::size_t left;
+    std::size_t right;
+  };
+
+  // a std::string against a std::string or C string
+  template <typename T1, typename T2, typename std::enable_if<detail::is_text<T1>::value && detail::is_text<T2>::value && (detail::is_string<T1>::value || detail::is_string<T2>::value), int>::type = 0>
+  static std::string describe(const T1& t1, const char* relation, const T2& t2, detail::priority<3>) {
+    if (std::string(relation) != "!=")
+      return ordered(as_string(t1), relation, as_string(t2), t1, t2);
+    return text(t1, t2);
+  }
+
+  // both keyed, e.g. std::map or std::set
+  template <typename T1, typename T2, typename std::enable_if<detail::is_keyed<T1>::value && detail::is_keyed<T2>::value, int>::type = 0>
+  static std::string describe(const T1& t1, const char* relation, const T2& t2, detail::priority<2>) {
+    if (std::string(relation) != "!=")
+      return show(t1) + " " + relation + " " + show(t2);
+    return keyed(t1, t2, detail::is_mapped<T1>());
+  }
+
+  // both sequences
+  template <typename T1, typename T2, typename std::enable_if<detail::is_sequence<T1>::value && detail::is_sequence<T2>::value, int>::type = 0>
+  static std::string describe(const T1& t1, const char* relation, const T2& t2, detail::priority<1>) {
+    if (std::string(relation) != "!=")
+      return show(t1) + " " + relation + " " + show(t2);
+    return sequences(t1, t2);
+  }
+
+  template <typename T1, typename T2>
+  static std::string describe(const T1& t1, const char* relation, const T2& t2, detail::priority<0>) {
+    return describe_scalar(t1, relation, t2);
+  }
+
+  // as Formatter::concat would
+  template <typename T1, typename T2, typename std::enable_if<detail::is_streamable<T1>::value && detail::is_streamable<T2>::value, int>::type = 0>
+  static std::string describe_scalar(const T1& t1, const char* relation, const T2& t2) {
+    std::stringstream out;
+    out << t1 << " " << relation << " " << t2 << " ";
+    return out.str();
+  }
+
+  template <typename T1, typename T2, typename std::enable_if<!(detail::is_streamable<T1>::value && detail::is_streamable<T2>::value), int>::type = 0>
+  static std::string describe_scalar(const T1& t1, const char* relation, const T2& t2) {
+    return show(t1) + " " + relation + " " + show(t2);
+  }
+
+  template <typename T1, typename T2>
+  static std::string text(const T1& t1, const T2& t2) {
+    return strings(as_string(t1), as_string(t2), t1, t2);
+  }
+
+  template <typename Traits, typename Alloc>
+  static const std::basic_string<char, Traits, Alloc>& as_string(const std::basic_string<char, Traits, Alloc>& s) {
+    return s;
+  }
+
+  static std::string as_string(const char* s) {
+    return s ? s : "";
+  }
+
+  static bool fits(const std::string& s) {
+    return s.size() <= limits().small && s.find('\n') == std::string::npos;
+  }
+
+  template <typename Traits, typename Alloc>
+  static std::string render(const std::basic_string<char, Traits, Alloc>& s, detail::priority<4>) {
+    return quote(s.data(), std::min(s.size(), limits().width));
+  }
+
+  template <typename T, typename std::enable_if<detail::is_pair<T>::value, int>::type = 0>
+  static std::string render(const T& p, detail::priority<3>) {
+    return "(" + show(p.first) + ", " + show(p.second) + ")";
+  }
+
+  template <typename T, typename std::enable_if<detail::is_tuple<T>::value, int>::type = 0>
+  static std::string render(const T& t, detail::priority<3>) {
+    return "(" + items<0>(t, std::integral_constant<bool, (std::tuple_size<T>::value > 0)>()) + ")";
+  }
+
+  template <std::size_t I, typename T>
+  static std::string items(const T& t, std::true_type) {
+    return (I ? ", " : "") + show(std::get<I>(t)) + items<I + 1>(t, std::integral_constant<bool, (I + 1 < std::tuple_size<T>::value)>());
+  }
+
+  template <std::size_t I, typename T>
+  static std::string items(const T&, std::false_type) {
+    return std::string();
+  }
+
+  template <typename T, typename std::enable_if<detail::is_sequence<T>::value, int>::type = 0>
+  static std::string render(const T& range, detail::priority<2>) {
+    std::string s = "{";
+    std::size_t n = 0;
+    for (const auto& e : range) {
+      if (s.size() > limits().width) {
+        s += ", ...";
+        break;
+      }
+      s += (n++ ? ", " : "") + show(e);
+    }
+    return s + "}";
+  }
+
+  template <typename T, typename std::enable_if<detail::is_streamable<T>::value, int>::type = 0>
+  static std::string render(const T& value, detail::priority<1>) {
+    std::stringstream out;
+    out << value;
+    return out.str();
+  }
+
+  template <typename T>
+  static std::string render(const T&, detail::priority<0>) {
+    return "<unprintable>";
+  }
+
+  static std::string clip(std::string s) {
+    if (s.size() > limits().width)
+      s = s.substr(0, limits().width - 3) + "...";
+    return s;
+  }
+
+  static std::string quote(const char* data, std::size_t size) {
+    std::string s = "\"";
+    for (std::size_t i = 0; i < size; ++i) {
+      switch(data[i]) {
+        case '"': s += "\\\""; break;
+        case '\\': s += "\\\\"; break;
+        case '\n': s += "\\n"; break;
+        case '\r': s += "\\r"; break;
+        case '\t': s += "\\t"; break;
+        default: s += data[i];
+      }
+    }
+    return s + "\"";
+  }
+
+  // the shortest edit script turning left into right, if it takes at most
+  // limit edits; the trace costs limit squared, so the limit stays small
+  template <typename Equal>
+  static bool myers(std::size_t n, std::size_t m, const Equal& equal, std::size_t limit, std::vector<Edit>& script) {
+    typedef std::ptrdiff_t index;
+    const index N = n, M = m, offset = limit + 1;
+    std::vector<index> v(2 * limit + 3, 0);
+    std::vector<std::vector<index>> trace;
+
+    for (index d = 0; d <= static_cast<index>(limit); ++d) {
+      trace.push_back(v);
+      for (index k = -d; k <= d; k += 2) {
+        index x = (k == -d || (k != d && v[offset + k - 1] < v[offset + k + 1])) ? v[offset + k + 1] : v[offset + k - 1] + 1;
+        index y = x - k;
+        while (x < N && y < M && equal(x, y)) {
+          ++x;
+          ++y;
+        }
+        v[offset + k] = x;
+        if (x >= N && y >= M) {
+          backtrack(trace, offset, N, M, script);
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  static void backtrack(const std::vector<std::vector<std::ptrdiff_t>>& trace, std::ptrdiff_t offset, std::ptrdiff_t x, std::ptrdiff_t y, std::vector<Edit>& script) {
+    for (std::ptrdiff_t d = trace.size() - 1; d >= 0; --d) {
+      const auto& v = trace[d];
+      auto k = x - y;
+      auto previous = (k == -d || (k != d && v[offset + k - 1] < v[offset + k + 1])) ? k + 1 : k - 1;
+      auto px = v[offset + previous];
+      auto py = px - previous;
+      while (x > px && y > py) {
+        --x;
+        --y;
+        script.push_back({Op::Keep, static_cast<std::size_t>(x), static_cast<std::size_t>(y)});
+      }
+      if (d > 0) {
+        if (x == px)
+          script.push_back({Op::Insert, static_cast<std::size_t>(x), static_cast<std::size_t>(py)});
+        else
+          script.push_back({Op::Remove, static_cast<std::size_t>(px), static_cast<std::size_t>(y)});
+      }
+      x = px;
+      y = py;
+    }
+    std::reverse(script.begin(), script.end());
+  }
+
+  // prints the edits with a little context around each, numbered from
+  // first; line renders an element of either side
+  template <typename Line>
+  static void hunks(std::ostream& out, const std::vector<Edit>& script, std::size_t first, const Line& line) {
+    auto context = limits().context;
+    std::vector<bool> shown(script.size(), false);
+    for (std::size_t i = 0; i < script.size(); ++i) {
+      if (script[i].op == Op::Keep)
+        continue;
+      auto from = (i > context) ? i - context : 0;
+      auto to = std::min(script.size(), i + context + 1);
+      for (auto j = from; j < to; ++j)
+        shown[j] = true;
+    }
+
+    std::size_t printed = 0;
+    std::size_t differences = 0;
+    bool gap = false;
+    for (std::size_t i = 0; i < script.size(); ++i) {
+      const auto& e = script[i];
+      if (e.op != Op::Keep)
+        ++differences;
+      if (!shown[i]) {
+        gap = true;
+        continue;
+      }
+      if (printed >= limits().lines)
+        continue;
+      if (gap && printed > 0)
+        out << "\n  ...";
+      gap = false;
+      auto at = first + ((e.op == Op::Insert) ? e.right : e.left);
+      out << "\n" << static_cast<char>(e.op) << " [" << at << "] " << line(e);
+      ++printed;
+    }
+    if (printed >= limits().lines)
+      out << "\n  ... " << differences << " differences in all";
+  }
+
+  // edits past the last equal element of a window that stopped short of
+  // the end are the window's doing, not the values'
+  static void cut(std::vector<Edit>& script) {
+    while (!script.empty() && script.back().op != Op::Keep)
+      script.pop_back();
+  }
+
+  template <typename It1, typename It2>
+  static std::size_t common_suffix(It1 b1, It1 e1, It2 b2, It2 e2, std::size_t limit, std::bidirectional_iterator_tag) {
+    std::size_t n = 0;
+    while (n < limit && e1 != b1 && e2 != b2) {
+      --e1;
+      --e2;
+      if (!(*e1 == *e2))
+        break;
+      ++n;
+    }
+    return n;
+  }
+
+  template <typename It1, typename It2>
+  static std::size_t common_suffix(It1, It1, It2, It2, std::size_t, std::forward_iterator_tag) {
+    return 0;
+  }
+
+  template <typename T1, typename T2>
+  static std::string sequences(const T1& t1, const T2& t2) {
+    auto b1 = std::begin(t1), e1 = std::end(t1);
+    auto b2 = std::begin(t2), e2 = std::end(t2);
+    std::size_t n1 = std::distance(b1, e1), n2 = std::distance(b2, e2);
+
+    // everything before the first difference is skipped without copying
+    std::size_t prefix = 0;
+    auto i1 = b1;
+    auto i2 = b2;
+    while (i1 != e1 && i2 != e2 && *i1 == *i2) {
+      ++i1;
+      ++i2;
+      ++prefix;
+    }
+    typedef typename std::iterator_traits<decltype(b1)>::iterator_category category;
+    auto suffix = common_suffix(b1, e1, b2, e2, std::min(n1, n2) - prefix, category());
+
+    std::stringstream out;
+    out << "sequences differ: sizes " << n1 << " vs " << n2 << ", first difference at [" << prefix << "]";
+
+    // a few equal elements ahead of the difference, then the differing
+    // middle and a few after, up to the window
+    auto context = std::min(prefix, limits().context);
+    auto first = prefix - context;
+    auto middle1 = n1 - prefix - suffix, middle2 = n2 - prefix - suffix;
+    auto size1 = std::min(context + middle1 + std::min(suffix, limits().context), limits().window);
+    auto size2 = std::min(context + middle2 + std::min(suffix, limits().context), limits().window);
+    std::vector<const typename std::decay<decltype(*b1)>::type*> left;
+    std::vector<const typename std::decay<decltype(*b2)>::type*> right;
+    gather(std::next(b1, first), e1, size1, left);
+    gather(std::next(b2, first), e2, size2, right);
+
+    std::vector<Edit> script;
+    bool found = myers(left.size(), right.size(), [&](std::size_t i, std::size_t j) {
+      return *left[i] == *right[j];
+    }, limits().edits, script);
+    if (!found) {
+      out << "\nmore than " << limits().edits << " differences within " << limits().window << " elements";
+      out << "\n- [" << prefix << "] " << (context < left.size() ? show(*left[context]) : "<end>");
+      out << "\n+ [" << prefix << "] " << (context < right.size() ? show(*right[context]) : "<end>");
+      return out.str();
+    }
+    bool whole = context + middle1 <= limits().window && context + middle2 <= limits().window;
+    if (!whole)
+      cut(script);
+    hunks(out, script, first, [&](const Edit& e) {
+      return (e.op == Op::Insert) ? show(*right[e.right]) : show(*left[e.left]);
+    });
+    if (!whole)
+      out << "\n  ... diffed the first " << limits().window << " elements from [" << first << "] only";
+    return out.str();
+  }
+
+  template <typename It, typename T>
+  static void gather(It it, It end, std::size_t n, std::vector<const T*>& out) {
+    for (; it != end && out.size() < n; ++it)
+      out.push_back(&*it);
+  }
+
+  // a view of one line, without its newline
+  struct Line {
+    const char* data;
+    std::size_t size;
+
+    bool operator == (const Line& other) const {
+      return size == other.size && std::equal(data, data + size, other.data);
+    }
+  };
+
+  // the lines from offset from, those starting before until and a little
+  // context after them, at most n
+  static bool lines(const std::string& s, std::size_t from, std::size_t until, std::size_t n, std::vector<Line>& out) {
+    std::size_t after = 0;
+    while (from <= s.size() && (from < until || after++ < limits().context)) {
+      if (out.size() == n)
+        return false;
+      auto end = std::min(s.find('\n', from), s.size());
+      out.push_back({s.data() + from, end - from});
+      from = end + 1;
+    }
+    return true;
+  }
+
+  // any other relation: both sides whole if small, else excerpts around
+  // where they part, or where the shorter one ends
+  template <typename T1, typename T2>
+  static std::string ordered(const std::string& s1, const char* relation, const std::string& s2, const T1& t1, const T2& t2) {
+    if (fits(s1) && fits(s2))
+      return describe_scalar(t1, relation, t2);
+
+    auto n = std::min(s1.size(), s2.size());
+    std::size_t at = std::mismatch(s1.begin(), s1.begin() + n, s2.begin()).first - s1.begin();
+    std::stringstream out;
+    if (at == n && s1.size() == s2.size())
+      out << "strings of length " << n << " are equal, first " << relation << " second";
+    else
+      out << "strings differ at offset " << at << ", lengths " << s1.size() << " vs " << s2.size() << ", first " << relation << " second";
+    excerpt(out, "\n- ", s1, at);
+    excerpt(out, "\n+ ", s2, at);
+    return out.str();
+  }
+
+  template <typename T1, typename T2>
+  static std::string strings(const std::string& s1, const std::string& s2, const T1& t1, const T2& t2) {
+    if (fits(s1) && fits(s2))
+      return describe_scalar(t1, "!=", t2);
+
+    auto n = std::min(s1.size(), s2.size());
+    std::size_t at = std::mismatch(s1.begin(), s1.begin() + n, s2.begin()).first - s1.begin();
+    std::size_t suffix = 0;
+    while (suffix < n - at && s1[s1.size() - 1 - suffix] == s2[s2.size() - 1 - suffix])
+      ++suffix;
+    auto line = std::count(s1.begin(), s1.begin() + at, '\n');
+    auto start = (at == 0) ? std::string::npos : s1.rfind('\n', at - 1);
+    start = (start == std::string::npos) ? 0 : start + 1;
+
+    std::stringstream out;
+    out << "strings differ at offset " << at << " (line " << line + 1 << ", column " << at - start + 1 << "), lengths " << s1.size() << " vs " << s2.size();
+
+    bool multiline = s1.find('\n', start) != std::string::npos || s2.find('\n', start) != std::string::npos;
+    if (!multiline) {
+      excerpt(out, "\n- ", s1, at);
+      excerpt(out, "\n+ ", s2, at);
+      return out.str();
+    }
+
+    // a few lines ahead of the one that differs
+    std::size_t skipped = 0;
+    for (; skipped < limits().context && start > 0; ++skipped) {
+      start = (start < 2) ? std::string::npos : s1.rfind('\n', start - 2);
+      start = (start == std::string::npos) ? 0 : start + 1;
+    }
+    std::vector<Line> left, right;
+    bool whole = lines(s1, start, s1.size() - suffix, limits().window, left);
+    whole = lines(s2, start, s2.size() - suffix, limits().window, right) && whole;
+
+    std::vector<Edit> script;
+    bool found = myers(left.size(), right.size(), [&](std::size_t i, std::size_t j) {
+      return left[i] == right[j];
+    }, limits().edits, script);
+    if (!found) {
+      out << "\nmore than " << limits().edits << " differing lines within " << limits().window;
+      excerpt(out, "\n- ", s1, at);
+      excerpt(out, "\n+ ", s2, at);
+      return out.str();
+    }
+    if (!whole)
+      cut(script);
+    std::size_t first = line + 1 - skipped;
+    hunks(out, script, first, [&](const Edit& e) {
+      const auto& l = (e.op == Op::Insert) ? right[e.right] : left[e.left];
+      return quote(l.data, std::min(l.size, limits().width)) + (l.size > limits().width ? "..." : "");
+    });
+    if (!whole)
+      out << "\n  ... diffed the first " << limits().window << " lines from line " << first << " only";
+    return out.str();
+  }
+
+  // the characters around offset at, marking where either end was cut
+  static void excerpt(std::ostream& out, const char* prefix, const std::string& s, std::size_t at) {
+    auto before = limits().width / 4;
+    auto from = (at > before) ? at - before : 0;
+    auto size = std::min(s.size() - std::min(from, s.size()), limits().width);
+    out << prefix << (from > 0 ? "..." : "") << quote(s.data() + from, size) << (from + size < s.size() ? "..." : "");
+  }
+
+  // maps: keys on one side only, and values that differ
+  template <typename T1, typename T2>
+  static std::string keyed(const T1& t1, const T2& t2, std::true_type) {
+    std::stringstream details;
+    std::size_t removed = 0, added = 0, changed = 0, printed = 0;
+    auto note = [&](char op, const std::string& text) {
+      if (printed++ < limits().lines)
+        details << "\n" << op << " " << text;
+    };
+    for (const auto& e : t1) {
+      auto found = t2.find(e.first);
+      if (found == t2.end()) {
+        ++removed;
+        note('-', show(e.first) + ": " + show(e.second));
+      }
+      else if (!(found->second == e.second)) {
+        ++changed;
+        note('~', show(e.first) + ": " + show(e.second) + " -> " + show(found->second));
+      }
+    }
+    for (const auto& e : t2) {
+      if (t1.find(e.first) == t1.end()) {
+        ++added;
+        note('+', show(e.first) + ": " + show(e.second));
+      }
+    }
+    return summary("maps", t1.size(), t2.size(), removed, added, changed, printed, details.str());
+  }
+
+  // sets: keys on one side only
+  template <typename T1, typename T2>
+  static std::string keyed(const T1& t1, const T2& t2, std::false_type) {
+    std::stringstream details;
+    std::size_t removed = 0, added = 0, printed = 0;
+    auto note = [&](char op, const std::string& text) {
+      if (printed++ < limits().lines)
+        details << "\n" << op << " " << text;
+    };
+    for (const auto& e : t1) {
+      if (t2.find(e) == t2.end()) {
+        ++removed;
+        note('-', show(e));
+      }
+    }
+    for (const auto& e : t2) {
+      if (t1.find(e) == t1.end()) {
+        ++added;
+        note('+', show(e));
+      }
+    }
+    return summary("sets", t1.size(), t2.size(), removed, added, 0, printed, details.str());
+  }
+
+  static std::string summary(const char* kind, std::size_t n1, std::size_t n2, std::size_t removed, std::size_t added, std::size_t changed, std::size_t printed, const std::string& details) {
+    std::stringstream out;
+    out << kind << " differ: sizes " << n1 << " vs " << n2 << ", only left " << removed << ", only right " << added;
+    if (changed > 0)
+      out << ", changed " << changed;
+    out << details;
+    if (printed > limits().lines)
+      out << "\n  ... " << printed - limits().lines << " more";
+    return out.str();
+  }
+};
+
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <unistd.h>
+
+#include <ut/thread_pool.hpp>
+
+namespace ut {
+
+// the threads async actions run on, shared by every test instead of a
+// thread per action; at most concurrency() async bodies run at once
+struct Executor {
+  // never destroyed, which would wait on bodies abandoned on timeout
+  static Executor& instance() {
+    static Executor* executor = new Executor();
+    return *executor;
+  }
+
+  std::size_t concurrency() const {
+    return limit;
+  }
+
+  // takes effect for actions submitted afterwards; the old pool finishes
+  // what it was given, see retire()
+  void concurrency(std::size_t n) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (n == 0)
+      n = default_concurrency();
+    if (n == limit)
+      return;
+    limit = n;
+    pool = nullptr;
+  }
+
+  void submit(task t) {
+    std::shared_ptr<ThreadPool> p;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      // a forked worker inherits the pool but none of its threads, which
+      // nothing can join
+      if (pool && owner != getpid())
+        new std::shared_ptr<ThreadPool>(std::move(pool));
+      if (!pool) {
+        pool = std::shared_ptr<ThreadPool>(new ThreadPool(limit), retire);
+        owner = getpid();
+      }
+      p = pool;
+    }
+    p->submit(std::move(t));
+  }
+
+private:
+  // destroying a pool joins its threads, one of which may be stuck in a body
+  // abandoned on timeout, so whoever drops it last hands that to a thread
+  static void retire(ThreadPool* p) {
+    std::thread([p]() { delete p; }).detach();
+  }
+
+  static std::size_t default_concurrency() {
+    auto n = std::thread::hardware_concurrency();
+    return (n == 0) ? 4 : n;
+  }
+
+  std::mutex mutex;
+  std::shared_ptr<ThreadPool> pool;
+  std::size_t limit = default_concurrency();
+  pid_t owner = 0;
+};
+
+}
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <ut/assertions.hpp>
+
+namespace ut {
+
+// a check that failed without stopping the test
+struct Expectation {
+  std::string message;
+  LocationInfo location;
+};
+
+// what ut_expect_* recorded while a test body ran; nothing here throws, so
+// checks can live in code built with -fno-exceptions, and a failure costs
+// neither unwinding nor a stack capture
+struct Expectations {
+  std::vector<Expectation> failures;
+
+  bool empty() const {
+    return failures.empty();
+  }
+
+  // the collector of the body running on this thread, if any
+  static Expectations*& current() {
+    static thread_local Expectations* value = nullptr;
+    return value;
+  }
+
+  // routes the calling thread's expectations into target while alive;
+  // nullptr, e.g. for hooks, makes them fail like assertions
+  struct Scope {
+    Scope(Expectations* target)
+      : previous(current())
+    {
+      current() = target;
+    }
+
+    ~Scope() {
+      current() = previous;
+    }
+
+    Expectations* previous;
+  };
+
+  // one line per failure, for the test's result
+  std::string str() const {
+    std::stringstream out;
+    out << failures.size() << (failures.size() == 1 ? " expectation" : " expectations") << " failed";
+    for (const auto& f : failures)
+      out << "\n  " << f.message << " " << f.location;
+    return out.str();
+  }
+
+  static void trim(std::string& text) {
+    Exception::trimmed(text);
+  }
+};
+
+// records a failure with the collector of the running test, or fails like
+// an assertion where there is none
+template <typename... Args>
+UT_COLD void unmet(std::string&& message, const Site& site, Args&&... args) {
+  auto expectations = Expectations::current();
+  if (!expectations) {
+    fail(std::move(message), site, std::forward<Args>(args)...);
+    return;
+  }
+
+  Expectations::trim(message);
+  if (sizeof...(Args) > 0) {
+    message = ut::Formatter().concat(message, std::forward<Args>(args)...);
+    Expectations::trim(message);
+  }
+  expectations->failures.push_back({std::move(message), LocationInfo(site)});
+}
+
+template <typename... Args>
+inline bool expect(bool value, const Site& site, Args&&... args) {
+  if (UT_LIKELY(value))
+    return true;
+
+  unmet(std::string("condition failed"), site, std::forward<Args>(args)...);
+  return false;
+}
+
+template <typename T1, typename T2, typename... Args>
+inline bool expect_eq(const T1& t1, const T2& t2, const Site& site, Args&&... args) {
+  if (UT_LIKELY(t1 == t2))
+    return true;
+
+  unmet(Diff::describe(t1, "!=", t2), site, std::forward<Args>(args)...);
+  return false;
+}
+
+template <typename T1, typename T2, typename... Args>
+inline bool expect_neq(const T1& t1, const T2& t2, const Site& site, Args&&... args) {
+  if (UT_LIKELY(t1 != t2))
+    return true;
+
+  unmet(Diff::describe(t1, "==", t2), site, std::forward<Args>(args)...);
+  return false;
+}
+
+template <typename T1, typename T2, typename... Args>
+inline bool expect_lt(const T1& t1, const T2& t2, const Site& site, Args&&... args) {
+  if (UT_LIKELY(t1 < t2))
+    return true;
+
+  unmet(Diff::describe(t1, "!<", t2), site, std::forward<Args>(args)...);
+  return false;
+}
+
+template <typename T1, typename T2, typename... Args>
+inline bool expect_lte(const T1& t1, const T2& t2, const Site& site, Args&&... args) {
+  if (UT_LIKELY(t1 <= t2))
+    return true;
+
+  unmet(Diff::describe(t1, "!<=", t2), site, std::forward<Args>(args)...);
+  return false;
+}
+
+template <typename T1, typename T2, typename... Args>
+inline bool expect_gt(const T1& t1, const T2& t2, const Site& site, Args&&... args) {
+  if (UT_LIKELY(t1 > t2))
+    return true;
+
+  unmet(Diff::describe(t1, "!>", t2), site, std::forward<Args>(args)...);
+  return false;
+}
+
+template <typename T1, typename T2, typename... Args>
+inline bool expect_gte(const T1& t1, const T2& t2, const Site& site, Args&&... args) {
+  if (UT_LIKELY(t1 >= t2))
+    return true;
+
+  unmet(Diff::describe(t1, "!>=", t2), site, std::forward<Args>(args)...);
+  return false;
+}
+
+}
+
+// like ut_assert*, but the test goes on and fails once it ends, reporting
+// every failed expectation; each evaluates to whether it held
+#define ut_expect(test, ...) \
+ut::expect(test, ut::Site{__FILE__, __LINE__, __func__}, ##__VA_ARGS__)
+
+#define ut_expect_eq(v1, v2, ...) \
+ut::expect_eq(v1, v2, ut::Site{__FILE__, __LINE__, __func__}, ##__VA_ARGS__)
+
+#define ut_expect_neq(v1, v2, ...) \
+ut::expect_neq(v1, v2, ut::Site{__FILE__, __LINE__, __func__}, ##__VA_ARGS__)
+
+#define ut_expect_lt(v1, v2, ...) \
+ut::expect_lt(v1, v2, ut::Site{__FILE__, __LINE__, __func__}, ##__VA_ARGS__)
+
+#define ut_expect_lte(v1, v2, ...) \
+ut::expect_lte(v1, v2, ut::Site{__FILE__, __LINE__, __func__}, ##__VA_ARGS__)
+
+#define ut_expect_gt(v1, v2, ...) \
+ut::expect_gt(v1, v2, ut::Site{__FILE__, __LINE__, __func__}, ##__VA_ARGS__)
+
+#define ut_expect_gte(v1, v2, ...) \
+ut::expect_gte(v1, v2, ut::Site{__FILE__, __LINE__, __func__}, ##__VA_ARGS__)
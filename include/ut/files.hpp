@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace ut {
+
+// what results, baselines and snapshots have in common on disk
+struct Files {
+  // keeps a path on one line of a tab separated file
+  static std::string escape(const std::string& path) {
+    std::string escaped;
+    for (auto c : path) {
+      if (c == '\\')
+        escaped += "\\\\";
+      else if (c == '\t')
+        escaped += "\\t";
+      else if (c == '\n')
+        escaped += "\\n";
+      else
+        escaped += c;
+    }
+    return escaped;
+  }
+
+  // into a temporary next to the file, then renamed over it, so an
+  // interrupted run never leaves the file truncated
+  static bool write(const std::string& file, const void* data, std::size_t size) {
+    auto temporary = file + ".XXXXXX";
+    int fd = mkstemp(&temporary[0]);
+    if (fd < 0)
+      return false;
+    auto p = static_cast<const char*>(data);
+    while (size > 0) {
+      auto n = ::write(fd, p, size);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0) {
+        ::close(fd);
+        std::remove(temporary.c_str());
+        return false;
+      }
+      p += n;
+      size -= n;
+    }
+    fchmod(fd, 0644);
+    bool ok = fsync(fd) == 0;
+    ok = (::close(fd) == 0) && ok;
+    if (!ok || std::rename(temporary.c_str(), file.c_str()) != 0) {
+      std::remove(temporary.c_str());
+      return false;
+    }
+    return true;
+  }
+
+  static bool write(const std::string& file, const std::string& text) {
+    return write(file, text.data(), text.size());
+  }
+};
+
+}
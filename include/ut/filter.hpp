@@ -0,0 +1,137 @@
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <regex>
+#include <string>
+#include <vector>
+
+namespace ut {
+
+// a --filter pattern compiled once into a matcher over the Registry paths
+// of tests, e.g. root/example1/subsuite/should be stubbed
+//
+// glob patterns match a path segment at a time: * and ? match within a
+// segment, ** matches any number of segments, and a pattern matching a
+// suite selects everything below it; the leading root/ may be omitted.
+// since a glob is consumed segment by segment, subtrees it can no longer
+// reach are pruned without being visited
+//
+// patterns starting with re: are regular expressions over the whole test
+// path, which cannot prune and are checked against every test
+struct Filter {
+  // the pattern positions still alive after consuming a suite path
+  struct Cursor {
+    std::vector<std::size_t> states;
+
+    bool alive() const {
+      return !states.empty();
+    }
+  };
+
+  Filter(const std::string& pattern = "") {
+    if (pattern.empty())
+      return;
+
+    if (pattern.compare(0, 3, "re:") == 0) {
+      regex.reset(new std::regex(pattern.substr(3)));
+      return;
+    }
+
+    std::size_t pos = 0;
+    while (pos <= pattern.size()) {
+      auto end = pattern.find('/', pos);
+      if (end == std::string::npos)
+        end = pattern.size();
+      segments.push_back(pattern.substr(pos, end - pos));
+      pos = end + 1;
+    }
+    if (segments.front() != "root" && segments.front() != "**")
+      segments.insert(segments.begin(), "root");
+  }
+
+  bool empty() const {
+    return segments.empty() && !regex;
+  }
+
+  // the cursor positioned below the root suite
+  Cursor root() const {
+    Cursor start;
+    close(start, 0);
+    return descend(start, "root");
+  }
+
+  Cursor descend(const Cursor& cursor, const std::string& segment) const {
+    Cursor next;
+    if (regex) {
+      next.states.push_back(0);
+      return next;
+    }
+
+    for (auto s : cursor.states) {
+      if (s == segments.size())
+        continue;
+      if (segments[s] == "**")
+        close(next, s);
+      else if (glob(segments[s], segment))
+        close(next, s + 1);
+    }
+    return next;
+  }
+
+  // true when the path leading to cursor matched completely, selecting the
+  // whole subtree below it
+  bool all(const Cursor& cursor) const {
+    return !regex && std::find(cursor.states.begin(), cursor.states.end(), segments.size()) != cursor.states.end();
+  }
+
+  bool selects(const Cursor& cursor, const std::string& suite_path, const std::string& test) const {
+    if (regex)
+      return std::regex_search(suite_path + "/" + test, *regex);
+    return all(descend(cursor, test));
+  }
+
+  static bool glob(const std::string& pattern, const std::string& text) {
+    std::size_t p = 0;
+    std::size_t t = 0;
+    std::size_t star = std::string::npos;
+    std::size_t mark = 0;
+    while (t < text.size()) {
+      if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == text[t])) {
+        ++p;
+        ++t;
+      }
+      else if (p < pattern.size() && pattern[p] == '*') {
+        star = p++;
+        mark = t;
+      }
+      else if (star != std::string::npos) {
+        p = star + 1;
+        t = ++mark;
+      }
+      else {
+        return false;
+      }
+    }
+    while (p < pattern.size() && pattern[p] == '*')
+      ++p;
+    return p == pattern.size();
+  }
+
+private:
+  // adds state s, and the states reachable from it by letting ** match no segments
+  void close(Cursor& cursor, std::size_t s) const {
+    while (true) {
+      if (std::find(cursor.states.begin(), cursor.states.end(), s) == cursor.states.end())
+        cursor.states.push_back(s);
+      if (s == segments.size() || segments[s] != "**")
+        return;
+      ++s;
+    }
+  }
+
+  std::vector<std::string> segments;
+  std::shared_ptr<std::regex> regex;
+};
+
+}
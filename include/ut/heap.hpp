@@ -0,0 +1,326 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+#include <malloc.h>
+
+#include <ut/assertions.hpp>
+
+// glibc's own entry points, beneath whatever replaces malloc and free
+#ifdef __GLIBC__
+extern "C" {
+void* __libc_malloc(std::size_t);
+void* __libc_calloc(std::size_t, std::size_t);
+void* __libc_realloc(void*, std::size_t);
+void* __libc_memalign(std::size_t, std::size_t);
+void __libc_free(void*);
+}
+#endif
+
+namespace ut {
+
+// heap traffic of one stretch of a thread's execution, in bytes as the
+// allocator hands them out
+struct Allocations {
+  // false unless tracking is installed, see ut_track_allocations()
+  bool measured = false;
+  std::size_t count = 0;
+  std::size_t frees = 0;
+  std::size_t bytes = 0;
+  // most bytes live at once beyond those live at the start
+  std::size_t peak = 0;
+  // bytes live at the end beyond those live at the start
+  std::int64_t live = 0;
+
+  std::int64_t blocks() const {
+    return static_cast<std::int64_t>(count) - static_cast<std::int64_t>(frees);
+  }
+
+  // more was allocated than freed and it is still around
+  bool leaked() const {
+    return blocks() > 0 && live > 0;
+  }
+
+  Allocations& operator += (const Allocations& a) {
+    measured = measured || a.measured;
+    count += a.count;
+    frees += a.frees;
+    bytes += a.bytes;
+    peak = std::max(peak, a.peak);
+    live += a.live;
+    return *this;
+  }
+};
+
+// counts what operator new and delete, and on glibc malloc and free, do on
+// every thread once ut_track_allocations() replaced them; figures are per
+// thread, so tests running side by side never see each other's, while
+// async bodies, which run on the shared executor, go unmeasured
+struct Heap {
+  // plain data, so touching it from inside the allocator never allocates
+  struct Counters {
+    std::size_t count;
+    std::size_t frees;
+    std::size_t bytes;
+    std::int64_t live;
+    std::int64_t peak;
+  };
+
+  static Counters& counters() {
+    static thread_local Counters c;
+    return c;
+  }
+
+  static bool& installed() {
+    static bool value = false;
+    return value;
+  }
+
+  static void allocated(void* p) {
+    if (!p)
+      return;
+    auto& c = counters();
+    auto size = malloc_usable_size(p);
+    ++c.count;
+    c.bytes += size;
+    c.live += size;
+    c.peak = std::max(c.peak, c.live);
+  }
+
+  static void freed(void* p) {
+    if (!p)
+      return;
+    auto& c = counters();
+    ++c.frees;
+    c.live -= malloc_usable_size(p);
+  }
+
+  // measures the calling thread until stop(); scopes nest, e.g. an
+  // allocation assertion inside a test
+  struct Scope {
+    Scope()
+      : start(counters()), outer(start.peak)
+    {
+      counters().peak = start.live;
+    }
+
+    Allocations stop() {
+      auto& c = counters();
+      Allocations a;
+      a.measured = installed();
+      a.count = c.count - start.count;
+      a.frees = c.frees - start.frees;
+      a.bytes = c.bytes - start.bytes;
+      a.peak = static_cast<std::size_t>(std::max<std::int64_t>(c.peak - start.live, 0));
+      a.live = c.live - start.live;
+      c.peak = std::max(c.peak, outer);
+      return a;
+    }
+
+    Counters start;
+    std::int64_t outer;
+  };
+
+  // what the replaced operators use, bypassing the interposed C functions
+  // so nothing is counted twice
+  static void* raw(std::size_t size) {
+#ifdef __GLIBC__
+    return __libc_malloc(size ? size : 1);
+#else
+    return std::malloc(size ? size : 1);
+#endif
+  }
+
+  static void* raw(std::size_t size, std::size_t alignment) {
+#ifdef __GLIBC__
+    return __libc_memalign(alignment, size ? size : 1);
+#else
+    void* p = nullptr;
+    return (posix_memalign(&p, std::max(alignment, sizeof(void*)), size ? size : 1) == 0) ? p : nullptr;
+#endif
+  }
+
+  static void release(void* p) {
+    freed(p);
+#ifdef __GLIBC__
+    __libc_free(p);
+#else
+    std::free(p);
+#endif
+  }
+
+  static void* allocate(std::size_t size, std::size_t alignment, bool nothrow) {
+    while (true) {
+      auto p = (alignment > alignof(std::max_align_t)) ? raw(size, alignment) : raw(size);
+      if (p) {
+        allocated(p);
+        return p;
+      }
+      auto handler = std::get_new_handler();
+      if (!handler) {
+        if (nothrow)
+          return nullptr;
+        throw std::bad_alloc();
+      }
+      handler();
+    }
+  }
+
+#ifdef __GLIBC__
+  static void* reallocate(void* p, std::size_t size) {
+    auto before = p ? malloc_usable_size(p) : 0;
+    auto q = __libc_realloc(p, size);
+    // a failed realloc leaves the block alone
+    if (!q && size > 0)
+      return q;
+    if (p) {
+      auto& c = counters();
+      ++c.frees;
+      c.live -= before;
+    }
+    allocated(q);
+    return q;
+  }
+#endif
+};
+
+template <typename... Args>
+void assert_tracked(const Allocations& a, Args&&... args) {
+  if (UT_LIKELY(a.measured))
+    return;
+
+  fail(std::string("allocations are not tracked, see ut_track_allocations()"), std::forward<Args>(args)...);
+}
+
+template <typename... Args>
+void assert_max_allocations(const Allocations& a, std::size_t limit, Args&&... args) {
+  assert_tracked(a, std::forward<Args>(args)...);
+  if (UT_LIKELY(a.count <= limit))
+    return;
+
+  mismatch(a.count, "allocations !<=", limit, std::forward<Args>(args)...);
+}
+
+template <typename... Args>
+void assert_max_allocated(const Allocations& a, std::size_t limit, Args&&... args) {
+  assert_tracked(a, std::forward<Args>(args)...);
+  if (UT_LIKELY(a.bytes <= limit))
+    return;
+
+  mismatch(a.bytes, "bytes allocated !<=", limit, std::forward<Args>(args)...);
+}
+
+template <typename... Args>
+void assert_no_leaks(const Allocations& a, Args&&... args) {
+  assert_tracked(a, std::forward<Args>(args)...);
+  if (UT_LIKELY(!a.leaked()))
+    return;
+
+  fail(ut::Formatter().concat(a.blocks(), "blocks of", a.live, "bytes leaked"), std::forward<Args>(args)...);
+}
+
+}
+
+#ifdef __GLIBC__
+// the C allocator, which C libraries and the standard library's own
+// operator new call into
+#define ut_track_c_allocations() \
+extern "C" void* malloc(std::size_t size) noexcept { \
+  auto p = __libc_malloc(size); \
+  ut::Heap::allocated(p); \
+  return p; \
+} \
+extern "C" void* calloc(std::size_t n, std::size_t size) noexcept { \
+  auto p = __libc_calloc(n, size); \
+  ut::Heap::allocated(p); \
+  return p; \
+} \
+extern "C" void* realloc(void* p, std::size_t size) noexcept { \
+  return ut::Heap::reallocate(p, size); \
+} \
+extern "C" void* memalign(std::size_t alignment, std::size_t size) noexcept { \
+  auto p = __libc_memalign(alignment, size); \
+  ut::Heap::allocated(p); \
+  return p; \
+} \
+extern "C" void* aligned_alloc(std::size_t alignment, std::size_t size) noexcept { \
+  return memalign(alignment, size); \
+} \
+extern "C" int posix_memalign(void** p, std::size_t alignment, std::size_t size) noexcept { \
+  if (alignment < sizeof(void*) || (alignment & (alignment - 1)) != 0) \
+    return EINVAL; \
+  *p = memalign(alignment, size); \
+  return *p ? 0 : ENOMEM; \
+} \
+extern "C" void free(void* p) noexcept { \
+  ut::Heap::release(p); \
+}
+#else
+#define ut_track_c_allocations()
+#endif
+
+#ifdef __cpp_aligned_new
+#define ut_track_aligned_allocations() \
+void* operator new(std::size_t size, std::align_val_t a) { return ut::Heap::allocate(size, static_cast<std::size_t>(a), false); } \
+void* operator new[](std::size_t size, std::align_val_t a) { return ut::Heap::allocate(size, static_cast<std::size_t>(a), false); } \
+void* operator new(std::size_t size, std::align_val_t a, const std::nothrow_t&) noexcept { return ut::Heap::allocate(size, static_cast<std::size_t>(a), true); } \
+void* operator new[](std::size_t size, std::align_val_t a, const std::nothrow_t&) noexcept { return ut::Heap::allocate(size, static_cast<std::size_t>(a), true); } \
+void operator delete(void* p, std::align_val_t) noexcept { ut::Heap::release(p); } \
+void operator delete[](void* p, std::align_val_t) noexcept { ut::Heap::release(p); } \
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { ut::Heap::release(p); } \
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { ut::Heap::release(p); } \
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { ut::Heap::release(p); } \
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { ut::Heap::release(p); }
+#else
+#define ut_track_aligned_allocations()
+#endif
+
+// replaces the global allocation functions so every test's heap traffic is
+// counted; use once, at global scope, in one translation unit of the test
+// executable
+#define ut_track_allocations() \
+void* operator new(std::size_t size) { return ut::Heap::allocate(size, 0, false); } \
+void* operator new[](std::size_t size) { return ut::Heap::allocate(size, 0, false); } \
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return ut::Heap::allocate(size, 0, true); } \
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return ut::Heap::allocate(size, 0, true); } \
+void operator delete(void* p) noexcept { ut::Heap::release(p); } \
+void operator delete[](void* p) noexcept { ut::Heap::release(p); } \
+void operator delete(void* p, std::size_t) noexcept { ut::Heap::release(p); } \
+void operator delete[](void* p, std::size_t) noexcept { ut::Heap::release(p); } \
+void operator delete(void* p, const std::nothrow_t&) noexcept { ut::Heap::release(p); } \
+void operator delete[](void* p, const std::nothrow_t&) noexcept { ut::Heap::release(p); } \
+ut_track_aligned_allocations() \
+ut_track_c_allocations() \
+static const bool ut_allocations_tracked = (ut::Heap::installed() = true);
+
+// the block performs at most limit allocations, or allocates at most limit
+// bytes, or leaves nothing it allocated behind; the block comes last, so
+// commas in it need no extra parentheses
+#define ut_assert_max_allocations(limit, ...) \
+{ \
+  ut::Heap::Scope ut_scope; \
+  __VA_ARGS__; \
+  auto ut_allocations = ut_scope.stop(); \
+  ut::assert_max_allocations(ut_allocations, limit, ut::Site{__FILE__, __LINE__, __func__}); \
+}
+
+#define ut_assert_max_allocated(limit, ...) \
+{ \
+  ut::Heap::Scope ut_scope; \
+  __VA_ARGS__; \
+  auto ut_allocations = ut_scope.stop(); \
+  ut::assert_max_allocated(ut_allocations, limit, ut::Site{__FILE__, __LINE__, __func__}); \
+}
+
+#define ut_assert_no_leaks(...) \
+{ \
+  ut::Heap::Scope ut_scope; \
+  __VA_ARGS__; \
+  auto ut_allocations = ut_scope.stop(); \
+  ut::assert_no_leaks(ut_allocations, ut::Site{__FILE__, __LINE__, __func__}); \
+}
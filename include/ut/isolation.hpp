@@ -0,0 +1,895 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <execinfo.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <ut/options.hpp>
+#include <ut/test.hpp>
+#include <ut/watchdog.hpp>
+
+namespace ut {
+
+// executes jobs (the hooks and tests of one suite) in pre-forked worker
+// processes, so a crash, abort or resource limit violation fails the test
+// that caused it and a fresh worker carries on with the rest of the suite
+struct ProcessPool {
+  enum : std::size_t { npos = static_cast<std::size_t>(-1) };
+
+  // lives in memory shared with the parent, so the parent learns which test
+  // a dead worker was running without a syscall per test
+  struct Progress {
+    std::atomic<std::size_t> index;
+    std::atomic<std::int64_t> started;
+    // the hook running, if any, a literal at the same address in the parent
+    std::atomic<const char*> hook;
+  };
+
+  static std::int64_t now() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  // length prefixed binary records exchanged over the pipes
+  struct Encoder {
+    std::string data;
+
+    Encoder(char type) {
+      data.resize(4);
+      data.push_back(type);
+    }
+
+    void put(std::uint64_t v) {
+      data.append(reinterpret_cast<const char*>(&v), sizeof(v));
+    }
+
+    void put(const std::string& s) {
+      put(static_cast<std::uint64_t>(s.size()));
+      data.append(s);
+    }
+
+    void real(double v) {
+      data.append(reinterpret_cast<const char*>(&v), sizeof(v));
+    }
+
+    const std::string& finish() {
+      std::uint32_t size = data.size() - 4;
+      std::memcpy(&data[0], &size, 4);
+      return data;
+    }
+  };
+
+  // an Encoder over a fixed buffer, for the crash handler, which must not
+  // allocate; the size is written by finish() as well
+  struct Raw {
+    char data[4096];
+    std::size_t size = 0;
+
+    void append(const void* p, std::size_t n) {
+      n = std::min(n, sizeof(data) - size);
+      std::memcpy(data + size, p, n);
+      size += n;
+    }
+
+    void put(std::uint64_t v) {
+      append(&v, sizeof(v));
+    }
+
+    void text(const char* s) {
+      append(s, std::strlen(s));
+    }
+
+    void number(std::uint64_t v) {
+      char digits[20];
+      std::size_t n = 0;
+      do {
+        digits[n++] = static_cast<char>('0' + v % 10);
+        v /= 10;
+      } while (v > 0);
+      while (n > 0)
+        append(&digits[--n], 1);
+    }
+
+    void finish() {
+      std::uint32_t length = size - 4;
+      std::memcpy(data, &length, 4);
+    }
+  };
+
+  struct Decoder {
+    const char* pos;
+    const char* end;
+
+    std::uint64_t u64() {
+      std::uint64_t v = 0;
+      if (end - pos >= static_cast<std::ptrdiff_t>(sizeof(v))) {
+        std::memcpy(&v, pos, sizeof(v));
+        pos += sizeof(v);
+      }
+      return v;
+    }
+
+    double real() {
+      double v = 0;
+      if (end - pos >= static_cast<std::ptrdiff_t>(sizeof(v))) {
+        std::memcpy(&v, pos, sizeof(v));
+        pos += sizeof(v);
+      }
+      return v;
+    }
+
+    std::string str() {
+      std::size_t size = std::min<std::uint64_t>(u64(), end - pos);
+      std::string s(pos, size);
+      pos += size;
+      return s;
+    }
+  };
+
+  static bool write_all(int fd, const char* data, std::size_t size) {
+    while (size > 0) {
+      auto n = ::write(fd, data, size);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        return false;
+      data += n;
+      size -= n;
+    }
+    return true;
+  }
+
+  static bool read_all(int fd, char* data, std::size_t size) {
+    while (size > 0) {
+      auto n = ::read(fd, data, size);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        return false;
+      data += n;
+      size -= n;
+    }
+    return true;
+  }
+
+  static std::string describe(int status) {
+    if (WIFSIGNALED(status))
+      return "terminated by signal " + std::to_string(WTERMSIG(status)) + " (" + strsignal(WTERMSIG(status)) + ")";
+    return "worker exited with status " + std::to_string(WEXITSTATUS(status));
+  }
+
+  // worker side of a job: reports test results back to the parent in
+  static void put(Encoder& record, const ut::Exception& e) {
+    record.put(std::string(e.what()));
+    record.put(e.location.file);
+    record.put(e.location.line);
+    record.put(e.location.func);
+    // workers share the parent's address space layout, so raw return
+    // addresses stay meaningful and are symbolized only if printed
+    record.put(e.stack.addresses.size());
+    for (auto addr : e.stack.addresses)
+      record.put(reinterpret_cast<std::uint64_t>(addr));
+    record.put(e.stack.text);
+  }
+
+  static std::shared_ptr<ut::Exception> exception(Decoder& in) {
+    auto message = in.str();
+    auto file = in.str();
+    auto line = in.u64();
+    auto func = in.str();
+    auto e = std::make_shared<ut::Exception>(std::move(message), LocationInfo{file, line, func});
+    e->stack.addresses.resize(in.u64());
+    for (auto& addr : e->stack.addresses)
+      addr = reinterpret_cast<void*>(in.u64());
+    e->stack.text = in.str();
+    return e;
+  }
+
+  // batches and applies the per-test resource limits
+  struct Channel {
+    Channel(int fd_, Progress& progress_, const Options& options_)
+      : fd(fd_), progress(progress_), options(options_), flushed(now())
+    {
+      getrlimit(RLIMIT_AS, &memory);
+      getrlimit(RLIMIT_CPU, &cpu);
+    }
+
+    int fd;
+    Progress& progress;
+    const Options& options;
+    std::vector<std::size_t> skip;
+    std::string buffer;
+    std::int64_t flushed;
+    rlimit memory;
+    rlimit cpu;
+    // failures seen by this worker; the parent counts those of all workers
+    std::size_t failures = 0;
+
+    bool skipped(std::size_t index) const {
+      return std::find(skip.begin(), skip.end(), index) != skip.end();
+    }
+
+    // the parent stops the run at this point anyway
+    bool cancelled() const {
+      return options.max_failures > 0 && failures >= options.max_failures;
+    }
+
+    void started(std::size_t index) {
+      progress.started = now();
+      progress.index = index;
+      if (options.memory_limit > 0) {
+        rlimit limit = memory;
+        limit.rlim_cur = std::min<rlim_t>(memory.rlim_max, mapped() + options.memory_limit);
+        setrlimit(RLIMIT_AS, &limit);
+      }
+      if (options.cpu_limit > 0) {
+        rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        rlimit limit = cpu;
+        limit.rlim_cur = std::min<rlim_t>(cpu.rlim_max, usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + 1 + options.cpu_limit);
+        setrlimit(RLIMIT_CPU, &limit);
+      }
+    }
+
+    void finished(std::size_t job, std::size_t index, const Test& test) {
+      if (options.memory_limit > 0)
+        setrlimit(RLIMIT_AS, &memory);
+      if (options.cpu_limit > 0)
+        setrlimit(RLIMIT_CPU, &cpu);
+
+      const auto& outcome = test.result();
+      Encoder record('T');
+      record.put(job);
+      record.put(index);
+      record.put(test.failed);
+      record.put(outcome.microseconds);
+      record.put(outcome.exception != nullptr);
+      if (outcome.exception)
+        put(record, *outcome.exception);
+      else {
+        record.put(outcome.message);
+      }
+      record.put(outcome.out);
+      record.put(outcome.err);
+      const auto& u = outcome.usage;
+      for (auto v : {u.user_microseconds, u.system_microseconds, u.voluntary_switches, u.involuntary_switches, u.minor_faults, u.major_faults, u.max_rss_delta})
+        record.put(v);
+      const auto& a = outcome.allocations;
+      record.put(a.measured);
+      for (auto v : {a.count, a.frees, a.bytes, a.peak})
+        record.put(v);
+      record.put(static_cast<std::uint64_t>(a.live));
+      record.put(outcome.statistics != nullptr);
+      if (outcome.statistics) {
+        const auto& s = *outcome.statistics;
+        record.put(s.samples);
+        record.put(s.iterations);
+        for (auto v : {s.min, s.median, s.mean, s.stddev, s.p99})
+          record.real(v);
+      }
+      record.put(test.rows != nullptr);
+      if (test.rows) {
+        const auto& r = *test.rows;
+        for (auto v : {r.total, r.ran, r.passed, r.failed, r.failures.size()})
+          record.put(v);
+        for (const auto& f : r.failures) {
+          record.put(f.row);
+          record.put(f.message);
+          record.put(f.file);
+          record.put(f.line);
+          record.put(f.func);
+        }
+      }
+      record.put(test.cases != nullptr);
+      if (test.cases) {
+        const auto& c = *test.cases;
+        for (auto v : {c.ran, c.rejected, c.shrinks})
+          record.put(v);
+        record.put(c.seed);
+        record.real(c.seconds);
+      }
+      buffer += record.finish();
+
+      // batch results for short tests, but never sit on them for long, nor
+      // on a failure that may cancel the run
+      auto time = now();
+      if (test.failed)
+        ++failures;
+      if (buffer.size() >= 65536 || time - flushed >= 10000 || (test.failed && options.max_failures > 0))
+        flush();
+    }
+
+    // a crash or time limit from here on fails the hook rather than a test
+    void hooking(const char* hook) {
+      progress.hook = hook;
+    }
+
+    // a before or after hook of the job failed; a failed before hook leaves
+    // the job's tests unrun
+    void hook(std::size_t job, const ut::Exception& failure) {
+      Encoder record('H');
+      record.put(job);
+      put(record, failure);
+      buffer += record.finish();
+      ++failures;
+      flush();
+    }
+
+    void done(std::size_t job) {
+      Encoder record('D');
+      record.put(job);
+      buffer += record.finish();
+      flush();
+    }
+
+    void crashed(const std::string& message) {
+      Encoder record('C');
+      record.put(message);
+      record.put(std::uint64_t(0));
+      buffer += record.finish();
+      flush();
+    }
+
+    // the same record from the crash handler, built in place with the raw
+    // frames, which the parent symbolizes; results batched so far go first
+    void crashed(const Raw& message, void* const* frames, int depth) {
+      write_all(fd, buffer.data(), buffer.size());
+      Raw record;
+      record.size = 4;
+      record.append("C", 1);
+      record.put(message.size);
+      record.append(message.data, message.size);
+      record.put(static_cast<std::uint64_t>(std::max(depth, 0)));
+      for (int i = 0; i < depth; ++i)
+        record.put(reinterpret_cast<std::uintptr_t>(frames[i]));
+      record.finish();
+      write_all(fd, record.data, record.size);
+    }
+
+    void flush() {
+      write_all(fd, buffer.data(), buffer.size());
+      buffer.clear();
+      flushed = now();
+    }
+
+    static std::size_t mapped() {
+      std::size_t pages = 0;
+      if (auto f = fopen("/proc/self/statm", "r")) {
+        if (fscanf(f, "%zu", &pages) != 1)
+          pages = 0;
+        fclose(f);
+      }
+      return pages * sysconf(_SC_PAGESIZE);
+    }
+  };
+
+  typedef std::function<void(std::size_t job, std::size_t first, Channel& channel)> job_runner;
+
+  struct Job {
+    std::vector<const Test*> tests;
+    std::size_t next = 0;
+    std::vector<std::size_t> skip;
+    bool done = false;
+    // what failed in its before or after hook
+    std::shared_ptr<ut::Exception> exception;
+    // whether any of its tests has a time limit to watch
+    bool limited = false;
+  };
+
+  struct Worker {
+    pid_t pid = -1;
+    int commands = -1;
+    int results = -1;
+    std::size_t job = npos;
+    std::string input;
+    std::string crash_message;
+    Stack crash_stack;
+    bool killed = false;
+  };
+
+  // each job is the list of tests one call of the runner executes, in order;
+  // results refer to tests by their position in that list
+  ProcessPool(const Options& options_, const std::vector<std::vector<const Test*>>& tests, const job_runner& runner_)
+    : options(options_), runner(runner_), workers(std::max<std::size_t>(options_.jobs, 1))
+  {
+    for (std::size_t i = 0; i < tests.size(); ++i) {
+      Job job;
+      job.tests = tests[i];
+      job.done = job.tests.empty();
+      for (auto test : job.tests)
+        job.limited = job.limited || test->limit().count() > 0;
+      jobs.push_back(job);
+      queue.push_back(i);
+    }
+
+    void* shared = mmap(nullptr, sizeof(Progress) * workers.size(), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED)
+      throw std::runtime_error("unable to map worker progress");
+    progress = static_cast<Progress*>(shared);
+
+    // a worker that died must not take the parent down with it
+    old_sigpipe = signal(SIGPIPE, SIG_IGN);
+
+    for (std::size_t i = 0; i < workers.size(); ++i) {
+      new (&progress[i]) Progress();
+      progress[i].index = static_cast<std::size_t>(npos);
+      progress[i].hook = nullptr;
+      spawn(i);
+    }
+  }
+
+  ~ProcessPool() {
+    for (auto& w : workers) {
+      close(w.commands);
+      close(w.results);
+    }
+    for (auto& w : workers) {
+      int status;
+      waitpid(w.pid, &status, 0);
+    }
+    munmap(progress, sizeof(Progress) * workers.size());
+    signal(SIGPIPE, old_sigpipe);
+  }
+
+  ProcessPool(const ProcessPool&) = delete;
+  ProcessPool& operator = (const ProcessPool&) = delete;
+
+  // dispatches queued jobs in this order rather than by number
+  void schedule(const std::vector<std::size_t>& order) {
+    queue.assign(order.begin(), order.end());
+  }
+
+  // blocks until every test of the job has a result, keeping the other
+  // workers busy in the meantime; returns what failed in its hooks, if any
+  std::shared_ptr<ut::Exception> wait(std::size_t job) {
+    while (!jobs[job].done)
+      pump();
+    return jobs[job].exception;
+  }
+
+private:
+  const Options& options;
+  job_runner runner;
+  std::vector<Job> jobs;
+  std::deque<std::size_t> queue;
+  std::vector<Worker> workers;
+  Progress* progress = nullptr;
+  void (*old_sigpipe)(int) = SIG_DFL;
+  std::size_t failures = 0;
+  bool cancelled = false;
+
+  void advance(Job& job) {
+    while (job.next < job.tests.size() && std::find(job.skip.begin(), job.skip.end(), job.next) != job.skip.end())
+      ++job.next;
+  }
+
+  void spawn(std::size_t slot) {
+    int commands[2];
+    int results[2];
+    if (pipe(commands) != 0 || pipe(results) != 0)
+      throw std::runtime_error("unable to create worker pipes");
+
+    std::cout.flush();
+    std::cerr.flush();
+    fflush(nullptr);
+
+    pid_t pid = fork();
+    if (pid < 0)
+      throw std::runtime_error("unable to fork worker");
+
+    if (pid == 0) {
+      close(commands[1]);
+      close(results[0]);
+      for (auto& w : workers) {
+        if (w.pid > 0) {
+          close(w.commands);
+          close(w.results);
+        }
+      }
+      serve(commands[0], results[1], progress[slot]);
+    }
+
+    close(commands[0]);
+    close(results[1]);
+    auto& w = workers[slot];
+    w = Worker();
+    w.pid = pid;
+    w.commands = commands[1];
+    w.results = results[0];
+  }
+
+  static Channel*& active() {
+    static Channel* channel = nullptr;
+    return channel;
+  }
+
+  // signal descriptions, looked up ahead of any crash
+  static const char** signal_names() {
+    static const char* names[NSIG] = {};
+    return names;
+  }
+
+  // only async-signal-safe calls from here on: the message goes into a fixed
+  // buffer, and the frames go out unsymbolized
+  static void crash_handler(int sig) {
+    if (auto channel = active()) {
+      Raw message;
+      if (sig == SIGALRM) {
+        message.text("timed out after ");
+        message.number(Watchdog::armed().count());
+        message.text("ms");
+      }
+      else {
+        message.text("terminated by signal ");
+        message.number(sig);
+        message.text(" (");
+        message.text(signal_names()[sig] ? signal_names()[sig] : "unknown");
+        message.text(")");
+      }
+      void* frames[64];
+      int depth = backtrace(frames, 64);
+      // skips the handler and the signal trampoline
+      channel->crashed(message, frames + 2, depth - 2);
+    }
+    raise(sig);
+  }
+
+  static void install_crash_handlers() {
+    static std::vector<char> alternate(1 << 20);
+    stack_t ss;
+    ss.ss_sp = alternate.data();
+    ss.ss_size = alternate.size();
+    ss.ss_flags = 0;
+    sigaltstack(&ss, nullptr);
+
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_handler = crash_handler;
+    action.sa_flags = SA_ONSTACK | SA_RESETHAND;
+    sigemptyset(&action.sa_mask);
+    for (int sig : {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT, SIGSYS, SIGXCPU, SIGXFSZ, SIGALRM}) {
+      signal_names()[sig] = strdup(strsignal(sig));
+      sigaction(sig, &action, nullptr);
+    }
+    // the first backtrace loads the unwinder, which must not happen in a handler
+    void* warmup[1];
+    backtrace(warmup, 1);
+  }
+
+  [[noreturn]] void serve(int commands, int results, Progress& slot) {
+    install_crash_handlers();
+    // time limits end the worker rather than abandoning a thread in it
+    Watchdog::in_process() = false;
+    Channel channel(results, slot, options);
+    active() = &channel;
+
+    std::uint32_t size;
+    while (read_all(commands, reinterpret_cast<char*>(&size), 4)) {
+      std::string payload(size, '\0');
+      if (!read_all(commands, &payload[0], size))
+        break;
+      Decoder in{payload.data() + 1, payload.data() + payload.size()};
+      auto job = in.u64();
+      auto first = in.u64();
+      channel.skip.resize(in.u64());
+      for (auto& s : channel.skip)
+        s = in.u64();
+
+      slot.index = static_cast<std::size_t>(npos);
+      slot.hook = nullptr;
+      try {
+        runner(job, first, channel);
+      }
+      catch(std::exception& e) {
+        channel.crashed(std::string("uncaught exception in hook: ") + e.what());
+        break;
+      }
+      catch(...) {
+        channel.crashed("uncaught exception in hook");
+        break;
+      }
+      channel.done(job);
+    }
+
+    channel.flush();
+    std::cout.flush();
+    std::cerr.flush();
+    fflush(nullptr);
+    _exit(0);
+  }
+
+  void dispatch() {
+    for (auto& w : workers) {
+      if (w.job != npos || queue.empty())
+        continue;
+      auto id = queue.front();
+      queue.pop_front();
+      auto& job = jobs[id];
+
+      Encoder command('J');
+      command.put(id);
+      command.put(job.next);
+      command.put(job.skip.size());
+      for (auto s : job.skip)
+        command.put(s);
+      const auto& data = command.finish();
+      w.job = id;
+      // the previous job's last test must not look overdue
+      progress[&w - workers.data()].index = static_cast<std::size_t>(npos);
+      progress[&w - workers.data()].hook = nullptr;
+      write_all(w.commands, data.data(), data.size());
+    }
+  }
+
+  void pump() {
+    dispatch();
+
+    std::vector<pollfd> fds;
+    std::vector<std::size_t> slots;
+    for (std::size_t i = 0; i < workers.size(); ++i) {
+      if (workers[i].job == npos)
+        continue;
+      fds.push_back({workers[i].results, POLLIN, 0});
+      slots.push_back(i);
+    }
+    if (fds.empty())
+      throw std::logic_error("waiting on a job that was never scheduled");
+
+    if (poll(fds.data(), fds.size(), overdue()) <= 0)
+      return;
+
+    char chunk[65536];
+    for (std::size_t i = 0; i < fds.size(); ++i) {
+      if (fds[i].revents == 0)
+        continue;
+      auto& w = workers[slots[i]];
+      auto n = ::read(w.results, chunk, sizeof(chunk));
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0) {
+        exited(slots[i]);
+        continue;
+      }
+      w.input.append(chunk, n);
+      receive(w);
+    }
+  }
+
+  // kills workers whose alarm failed to end them, once their test overran
+  // its limit twice over; returns the milliseconds until the next deadline
+  int overdue() {
+    int wait = -1;
+    auto time = now();
+    for (std::size_t i = 0; i < workers.size(); ++i) {
+      auto& w = workers[i];
+      if (w.job == npos || w.killed || !jobs[w.job].limited)
+        continue;
+      // check back shortly on a worker yet to start a test
+      std::size_t index = progress[i].index;
+      if (index >= jobs[w.job].tests.size()) {
+        wait = (wait < 0) ? 10 : std::min(wait, 10);
+        continue;
+      }
+      auto limit = jobs[w.job].tests[index]->limit();
+      if (limit.count() <= 0)
+        continue;
+      auto deadline = progress[i].started + 2000 * limit.count() + 1000000;
+      if (time >= deadline) {
+        kill(w.pid, SIGKILL);
+        w.killed = true;
+        w.crash_message = Watchdog::message(limit);
+        continue;
+      }
+      int ms = (deadline - time) / 1000 + 1;
+      wait = (wait < 0) ? ms : std::min(wait, ms);
+    }
+    return wait;
+  }
+
+  void receive(Worker& w) {
+    std::size_t pos = 0;
+    std::uint32_t size;
+    while (w.input.size() - pos >= 4) {
+      std::memcpy(&size, w.input.data() + pos, 4);
+      if (w.input.size() - pos - 4 < size)
+        break;
+      const char* data = w.input.data() + pos + 4;
+      Decoder in{data + 1, data + size};
+      switch(data[0]) {
+        case 'T':
+          result(in);
+          break;
+        case 'H': {
+          auto& job = jobs[in.u64()];
+          auto failure = exception(in);
+          if (!job.exception)
+            job.exception = failure;
+          failed();
+          break;
+        }
+        case 'D': {
+          // a worker stops its job early only once the run is cancelled or
+          // its before hook failed
+          auto& job = jobs[in.u64()];
+          if (cancelled || job.exception)
+            drop(job);
+          job.done = true;
+          w.job = npos;
+          break;
+        }
+        case 'C':
+          w.crash_message = in.str();
+          w.crash_stack.addresses.resize(in.u64());
+          for (auto& addr : w.crash_stack.addresses)
+            addr = reinterpret_cast<void*>(in.u64());
+          break;
+      }
+      pos += 4 + size;
+    }
+    w.input.erase(0, pos);
+  }
+
+  void result(Decoder& in) {
+    auto& job = jobs[in.u64()];
+    auto i = in.u64();
+    const auto& test = *job.tests[i];
+    auto& outcome = test.result();
+    test.failed = in.u64();
+    outcome.microseconds = in.u64();
+    outcome.seconds = outcome.microseconds / 1000000.0;
+    if (in.u64())
+      outcome.exception = exception(in);
+    else {
+      outcome.message = in.str();
+    }
+    outcome.out = in.str();
+    outcome.err = in.str();
+    auto& u = outcome.usage;
+    for (auto v : {&u.user_microseconds, &u.system_microseconds, &u.voluntary_switches, &u.involuntary_switches, &u.minor_faults, &u.major_faults, &u.max_rss_delta})
+      *v = in.u64();
+    auto& a = outcome.allocations;
+    a.measured = in.u64();
+    for (auto v : {&a.count, &a.frees, &a.bytes, &a.peak})
+      *v = in.u64();
+    a.live = static_cast<std::int64_t>(in.u64());
+    if (in.u64()) {
+      auto s = std::make_shared<Statistics>();
+      s->samples = in.u64();
+      s->iterations = in.u64();
+      for (auto v : {&s->min, &s->median, &s->mean, &s->stddev, &s->p99})
+        *v = in.real();
+      outcome.statistics = s;
+    }
+    if (in.u64() && test.rows) {
+      auto& r = *test.rows;
+      for (auto v : {&r.total, &r.ran, &r.passed, &r.failed})
+        *v = in.u64();
+      r.failures.resize(in.u64());
+      for (auto& f : r.failures) {
+        f.row = in.u64();
+        f.message = in.str();
+        f.file = in.str();
+        f.line = in.u64();
+        f.func = in.str();
+      }
+    }
+    if (in.u64() && test.cases) {
+      auto& c = *test.cases;
+      for (auto v : {&c.ran, &c.rejected, &c.shrinks})
+        *v = in.u64();
+      c.seed = in.u64();
+      c.seconds = in.real();
+    }
+    job.next = i + 1;
+    advance(job);
+    if (test.failed)
+      failed();
+  }
+
+  void failed() {
+    if (!cancelled && options.max_failures > 0 && ++failures >= options.max_failures)
+      cancel();
+  }
+
+  // stops the run once enough tests failed: queued jobs are dropped and busy
+  // workers killed, and every test without a result is cancelled
+  void cancel() {
+    cancelled = true;
+    for (auto id : queue)
+      drop(jobs[id]);
+    queue.clear();
+    for (auto& w : workers) {
+      if (w.pid > 0 && w.job != npos && !w.killed) {
+        kill(w.pid, SIGKILL);
+        w.killed = true;
+      }
+    }
+  }
+
+  void drop(Job& job) {
+    for (; job.next < job.tests.size(); ++job.next) {
+      if (std::find(job.skip.begin(), job.skip.end(), job.next) == job.skip.end())
+        job.tests[job.next]->cancelled = true;
+    }
+    job.done = true;
+  }
+
+  // fails the test a dead worker was running, then resumes its job on a
+  // replacement worker after that test
+  void exited(std::size_t slot) {
+    auto& w = workers[slot];
+    int status = 0;
+    close(w.commands);
+    close(w.results);
+    waitpid(w.pid, &status, 0);
+    w.pid = -1;
+
+    if (w.job != npos) {
+      auto& job = jobs[w.job];
+      const auto& tests = job.tests;
+      std::size_t i = progress[slot].index;
+      if (i >= tests.size())
+        i = job.next;
+      const char* hook = progress[slot].hook;
+      auto message = w.crash_message.empty() ? describe(status) : w.crash_message;
+      if (hook)
+        message = std::string(hook) + " hook: " + message;
+
+      // a dead before or after hook fails the suite, and the tests a before
+      // hook left unrun are cancelled, as in process
+      bool suite = hook && (std::strcmp(hook, "before") == 0 || std::strcmp(hook, "after") == 0);
+      if (suite && (!cancelled || !w.crash_message.empty())) {
+        if (!job.exception) {
+          job.exception = std::make_shared<ut::Exception>(std::move(message));
+          job.exception->stack = w.crash_stack;
+        }
+        failed();
+        drop(job);
+      }
+      // a worker killed to cancel the run did not crash by itself
+      else if (i < tests.size() && (!cancelled || !w.crash_message.empty())) {
+        const auto& test = *tests[i];
+        auto& outcome = test.result();
+        test.failed = true;
+        outcome.microseconds = now() - progress[slot].started;
+        outcome.seconds = outcome.microseconds / 1000000.0;
+        outcome.exception = std::make_shared<ut::Exception>(std::move(message));
+        outcome.exception->stack = w.crash_stack;
+        job.skip.push_back(i);
+        advance(job);
+        failed();
+      }
+
+      if (cancelled || job.exception)
+        drop(job);
+      else if (job.next < tests.size())
+        queue.push_front(w.job);
+      else
+        job.done = true;
+    }
+
+    spawn(slot);
+  }
+};
+
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace ut {
+
+// a read only view of a whole file, unmapped on destruction
+struct Mapping {
+  const unsigned char* data = nullptr;
+  std::size_t size = 0;
+
+  Mapping() {}
+  Mapping(const Mapping&) = delete;
+  Mapping& operator = (const Mapping&) = delete;
+
+  ~Mapping() {
+    if (data && size > 0)
+      munmap(const_cast<unsigned char*>(data), size);
+  }
+
+  bool open(const std::string& file) {
+    int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+      return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      ::close(fd);
+      return false;
+    }
+    size = st.st_size;
+    if (size == 0) {
+      ::close(fd);
+      static const unsigned char empty = 0;
+      data = &empty;
+      return true;
+    }
+    auto p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) {
+      size = 0;
+      return false;
+    }
+    madvise(p, size, MADV_SEQUENTIAL);
+    data = static_cast<const unsigned char*>(p);
+    return true;
+  }
+};
+
+}
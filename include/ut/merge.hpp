@@ -0,0 +1,225 @@
+#pragma once
+
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <ut/results.hpp>
+#include <ut/test.hpp>
+
+namespace ut {
+
+// reads the JSON lines JsonReporter wrote for several shards of a run back
+// into the tests, so the whole run can be reported as if it ran in one
+// process; tests no shard ran count as cancelled
+struct Merge {
+  typedef std::unordered_map<std::string, std::string> Fields;
+
+  // tests by Results::key, stubs left out
+  static void load(const std::vector<std::string>& files, const std::unordered_map<std::string, const Test*>& tests) {
+    for (const auto& t : tests)
+      t.second->cancelled = true;
+
+    for (const auto& file : files) {
+      std::ifstream in(file);
+      if (!in)
+        throw std::runtime_error("unable to read results " + file);
+      std::string line;
+      Fields fields;
+      while (std::getline(in, line)) {
+        fields.clear();
+        if (!parse(line, fields))
+          continue;
+        const auto& event = fields["event"];
+        if (event != "test_failed" && event != "test_succeeded")
+          continue;
+        auto found = tests.find(Results::key(fields["suite"], fields["test"]));
+        if (found != tests.end())
+          assign(*found->second, fields);
+      }
+    }
+  }
+
+  static void assign(const Test& test, Fields& fields) {
+    auto& result = test.result();
+    test.cancelled = false;
+    test.failed = (fields["event"] == "test_failed");
+    result.microseconds = std::strtoull(fields["microseconds"].c_str(), nullptr, 10);
+    result.seconds = result.microseconds / 1000000.0;
+    result.out = fields["stdout"];
+    result.err = fields["stderr"];
+
+    // only exceptions come with a location
+    if (fields.count("location.file")) {
+      result.exception = std::make_shared<ut::Exception>(std::move(fields["message"]), LocationInfo{fields["location.file"], std::strtoull(fields["location.line"].c_str(), nullptr, 10), fields["location.function"]});
+      result.exception->stack.text = fields["stack"];
+    }
+    else {
+      result.message = fields["message"];
+    }
+
+    if (fields.count("allocations.count")) {
+      auto& a = result.allocations;
+      a.measured = true;
+      a.count = std::strtoull(fields["allocations.count"].c_str(), nullptr, 10);
+      a.frees = std::strtoull(fields["allocations.frees"].c_str(), nullptr, 10);
+      a.bytes = std::strtoull(fields["allocations.bytes"].c_str(), nullptr, 10);
+      a.peak = std::strtoull(fields["allocations.peak"].c_str(), nullptr, 10);
+      a.live = std::strtoll(fields["allocations.live"].c_str(), nullptr, 10);
+    }
+
+    if (fields.count("statistics.samples")) {
+      auto s = std::make_shared<Statistics>();
+      s->samples = std::strtoull(fields["statistics.samples"].c_str(), nullptr, 10);
+      s->iterations = std::strtoull(fields["statistics.iterations"].c_str(), nullptr, 10);
+      s->min = std::strtod(fields["statistics.min"].c_str(), nullptr);
+      s->median = std::strtod(fields["statistics.median"].c_str(), nullptr);
+      s->mean = std::strtod(fields["statistics.mean"].c_str(), nullptr);
+      s->stddev = std::strtod(fields["statistics.stddev"].c_str(), nullptr);
+      s->p99 = std::strtod(fields["statistics.p99"].c_str(), nullptr);
+      result.statistics = s;
+    }
+
+    if (fields.count("rows.total") && test.rows) {
+      auto& r = *test.rows;
+      r.total = std::strtoull(fields["rows.total"].c_str(), nullptr, 10);
+      r.ran = std::strtoull(fields["rows.ran"].c_str(), nullptr, 10);
+      r.passed = std::strtoull(fields["rows.passed"].c_str(), nullptr, 10);
+      r.failed = std::strtoull(fields["rows.failed"].c_str(), nullptr, 10);
+      r.failures.clear();
+      const std::string prefix = "rows.failures.", suffix = ".message";
+      // looked up, never inserted, while iterating
+      auto value = [&](const std::string& key) {
+        auto found = fields.find(key);
+        return (found == fields.end()) ? std::string() : found->second;
+      };
+      for (const auto& f : fields) {
+        const auto& key = f.first;
+        if (key.compare(0, prefix.size(), prefix) != 0 || key.size() <= prefix.size() + suffix.size() || key.compare(key.size() - suffix.size(), suffix.size(), suffix) != 0)
+          continue;
+        auto at = key.substr(0, key.size() - suffix.size());
+        Rows::Failure failure;
+        failure.row = std::strtoull(at.c_str() + prefix.size(), nullptr, 10);
+        failure.message = f.second;
+        failure.file = value(at + ".file");
+        failure.line = std::strtoull(value(at + ".line").c_str(), nullptr, 10);
+        failure.func = value(at + ".function");
+        r.failures.push_back(std::move(failure));
+      }
+      r.trim(r.failures.size());
+    }
+
+    if (fields.count("cases.ran") && test.cases) {
+      auto& c = *test.cases;
+      c.ran = std::strtoull(fields["cases.ran"].c_str(), nullptr, 10);
+      c.rejected = std::strtoull(fields["cases.rejected"].c_str(), nullptr, 10);
+      c.shrinks = std::strtoull(fields["cases.shrinks"].c_str(), nullptr, 10);
+      c.seed = std::strtoull(fields["cases.seed"].c_str(), nullptr, 10);
+      c.seconds = std::strtod(fields["cases.seconds"].c_str(), nullptr);
+    }
+  }
+
+  // understands exactly what JsonReporter writes: an object of strings,
+  // numbers and nested objects, the latter flattened as "location.file"
+  static bool parse(const std::string& line, Fields& fields) {
+    std::size_t pos = 0;
+    return object(line, pos, "", fields);
+  }
+
+private:
+  static void skip(const std::string& s, std::size_t& pos) {
+    while (pos < s.size() && (s[pos] == ' ' || s[pos] == '\t' || s[pos] == '\r'))
+      ++pos;
+  }
+
+  static bool object(const std::string& s, std::size_t& pos, const std::string& prefix, Fields& fields) {
+    skip(s, pos);
+    if (pos >= s.size() || s[pos] != '{')
+      return false;
+    ++pos;
+    skip(s, pos);
+    if (pos < s.size() && s[pos] == '}') {
+      ++pos;
+      return true;
+    }
+
+    while (pos < s.size()) {
+      std::string key;
+      skip(s, pos);
+      if (!string(s, pos, key))
+        return false;
+      skip(s, pos);
+      if (pos >= s.size() || s[pos++] != ':')
+        return false;
+      skip(s, pos);
+      if (pos >= s.size())
+        return false;
+
+      if (s[pos] == '{') {
+        if (!object(s, pos, prefix + key + ".", fields))
+          return false;
+      }
+      else if (s[pos] == '"') {
+        if (!string(s, pos, fields[prefix + key]))
+          return false;
+      }
+      else {
+        auto end = s.find_first_of(",}", pos);
+        if (end == std::string::npos)
+          return false;
+        fields[prefix + key] = s.substr(pos, end - pos);
+        pos = end;
+      }
+
+      skip(s, pos);
+      if (pos >= s.size())
+        return false;
+      if (s[pos] == '}') {
+        ++pos;
+        return true;
+      }
+      if (s[pos++] != ',')
+        return false;
+    }
+    return false;
+  }
+
+  static bool string(const std::string& s, std::size_t& pos, std::string& value) {
+    if (pos >= s.size() || s[pos] != '"')
+      return false;
+    value.clear();
+    for (++pos; pos < s.size(); ++pos) {
+      char c = s[pos];
+      if (c == '"') {
+        ++pos;
+        return true;
+      }
+      if (c != '\\') {
+        value += c;
+        continue;
+      }
+      if (++pos >= s.size())
+        return false;
+      switch(s[pos]) {
+        case 'n': value += '\n'; break;
+        case 'r': value += '\r'; break;
+        case 't': value += '\t'; break;
+        // only ever written for control characters
+        case 'u':
+          if (pos + 4 >= s.size())
+            return false;
+          value += static_cast<char>(std::strtoul(s.substr(pos + 1, 4).c_str(), nullptr, 16));
+          pos += 4;
+          break;
+        default: value += s[pos];
+      }
+    }
+    return false;
+  }
+};
+
+}
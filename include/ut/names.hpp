@@ -0,0 +1,25 @@
+#pragma once
+
+#include <string>
+#include <unordered_set>
+
+namespace ut {
+
+// stores every distinct test name once, so a large tree that repeats names
+// across suites holds one string per name instead of one per test; set nodes
+// never move, so the references handed out stay valid for the process
+struct Names {
+  // tests register on one thread, as suites do with Registry, so taking a
+  // name costs a hash lookup and no lock
+  static const std::string& intern(const std::string& name) {
+    return *names().insert(name).first;
+  }
+
+  // created ahead of the first suite, so it outlives every test naming into it
+  static std::unordered_set<std::string>& names() {
+    static std::unordered_set<std::string> value;
+    return value;
+  }
+};
+
+}
@@ -0,0 +1,235 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <ut/benchmark.hpp>
+#include <ut/regression.hpp>
+#include <ut/table.hpp>
+
+namespace ut {
+
+struct Options {
+  // number of threads used to execute sibling suites, 1 runs serially
+  std::size_t jobs = 1;
+  std::string filter;
+
+  // symbolize failure stacks on a background thread as they are captured
+  bool background_symbols = false;
+
+  // warmup and target time in seconds, and samples per benchmark
+  Benchmark::Settings benchmark;
+
+  // time with the calibrated time stamp counter where it is invariant, and
+  // whether to record getrusage figures around every test
+  bool tsc = false;
+  bool usage = true;
+
+  // compare timings against a baseline file and/or save them as one; a
+  // significant slowdown beyond the threshold fails the run
+  std::string baseline;
+  std::string save_baseline;
+  Comparison::Thresholds regression;
+
+  // capture what tests write to stdout and stderr, keeping at most
+  // capture_limit bytes of each; only while tests run one at a time
+  bool capture = true;
+  std::size_t capture_limit = 65536;
+
+  // seconds any test or hook may take unless it declares its own limit, 0
+  // for none
+  double timeout = 0;
+
+  // file keeping every test's last outcome between runs; with failed_first
+  // the tests that failed last time run ahead of the rest
+  std::string results;
+  bool failed_first = false;
+
+  // stop starting tests once this many have failed, 0 for never; the rest
+  // are reported as cancelled
+  std::size_t max_failures = 0;
+
+  // run only this shard of the selected tests, balanced by the durations
+  // in results when there are any; every shard must see the same results
+  std::size_t shard = 0;
+  std::size_t shards = 1;
+
+  // instead of running anything, report the results JsonReporter wrote for
+  // each shard as one run
+  std::vector<std::string> merge;
+
+  // where ut_assert_snapshot keeps golden files, and whether to rewrite
+  // those the output no longer matches instead of failing
+  std::string snapshots = "snapshots";
+  bool update_snapshots = false;
+
+  // rows of table tests to run, as sorted inclusive ranges of row numbers,
+  // none for all, see Tables
+  std::vector<Tables::Range> rows;
+
+  // cases per property test, and the seed they are generated from, 0 for a
+  // new one each run, see Properties
+  std::size_t cases = 10000;
+  std::uint64_t seed = 0;
+
+  // upper bound on async test bodies running at once, 0 for hardware threads
+  std::size_t async_jobs = 0;
+
+  // run suites in forked worker processes, jobs of them, so crashes only
+  // fail the offending test; the limits apply to every test in isolation
+  bool isolate = false;
+  std::size_t memory_limit = 0;
+  std::size_t cpu_limit = 0;
+
+  Options() {}
+
+  Options(int argc, char* argv[]) {
+    parse(argc, argv);
+  }
+
+  // recognizes --jobs N, --jobs=N, -j N and -jN, where 0 selects the number
+  // of hardware threads, --memory-limit and --capture-limit accept K, M and
+  // G suffixes,
+  // --cpu-limit is in seconds, --regression-threshold is a fraction or a
+  // percentage and --regression-floor is in microseconds, --fail-fast stops
+  // at the first failure and --failed-first keeps results in .ut_results
+  // unless --results names a file, --shard i/n counts from 1, --merge may
+  // be repeated, --rows takes row numbers and ranges like 7,100-200,500-
+  // and --seed repeats the cases of a run a property failure reported;
+  // unknown arguments are left to the caller
+  void parse(int argc, char* argv[]) {
+    for (int i = 1; i < argc; ++i) {
+      std::string arg = argv[i];
+      std::string value;
+      if (match(arg, "--jobs", "-j", argc, argv, i, value))
+        jobs = count(value);
+      else if (match(arg, "--filter", "-f", argc, argv, i, value))
+        filter = value;
+      else if (match(arg, "--async-jobs", "", argc, argv, i, value))
+        async_jobs = count(value);
+      else if (arg == "--background-symbols")
+        background_symbols = true;
+      else if (match(arg, "--bench-warmup", "", argc, argv, i, value))
+        benchmark.warmup = std::strtod(value.c_str(), nullptr);
+      else if (match(arg, "--bench-time", "", argc, argv, i, value))
+        benchmark.time = std::strtod(value.c_str(), nullptr);
+      else if (match(arg, "--bench-samples", "", argc, argv, i, value))
+        benchmark.samples = std::strtoul(value.c_str(), nullptr, 10);
+      else if (arg == "--tsc")
+        tsc = true;
+      else if (arg == "--no-usage")
+        usage = false;
+      else if (match(arg, "--baseline", "", argc, argv, i, value))
+        baseline = value;
+      else if (match(arg, "--save-baseline", "", argc, argv, i, value))
+        save_baseline = value;
+      else if (match(arg, "--regression-threshold", "", argc, argv, i, value))
+        regression.threshold = fraction(value);
+      else if (match(arg, "--regression-alpha", "", argc, argv, i, value))
+        regression.alpha = std::strtod(value.c_str(), nullptr);
+      else if (match(arg, "--regression-floor", "", argc, argv, i, value))
+        regression.floor = std::strtod(value.c_str(), nullptr);
+      else if (match(arg, "--timeout", "", argc, argv, i, value))
+        timeout = std::strtod(value.c_str(), nullptr);
+      else if (match(arg, "--results", "", argc, argv, i, value))
+        results = value;
+      else if (arg == "--failed-first")
+        failed_first = true;
+      else if (arg == "--fail-fast")
+        max_failures = 1;
+      else if (match(arg, "--max-failures", "", argc, argv, i, value))
+        max_failures = std::strtoul(value.c_str(), nullptr, 10);
+      else if (match(arg, "--shard", "", argc, argv, i, value))
+        parse_shard(value);
+      else if (match(arg, "--merge", "", argc, argv, i, value))
+        merge.push_back(value);
+      else if (match(arg, "--rows", "", argc, argv, i, value))
+        rows = Tables::parse(value);
+      else if (match(arg, "--cases", "", argc, argv, i, value))
+        cases = std::strtoull(value.c_str(), nullptr, 10);
+      else if (match(arg, "--seed", "", argc, argv, i, value))
+        seed = std::strtoull(value.c_str(), nullptr, 10);
+      else if (match(arg, "--snapshots", "", argc, argv, i, value))
+        snapshots = value;
+      else if (arg == "--update-snapshots")
+        update_snapshots = true;
+      else if (arg == "--no-capture")
+        capture = false;
+      else if (match(arg, "--capture-limit", "", argc, argv, i, value))
+        capture_limit = bytes(value);
+      else if (arg == "--isolate")
+        isolate = true;
+      else if (match(arg, "--memory-limit", "", argc, argv, i, value))
+        memory_limit = bytes(value);
+      else if (match(arg, "--cpu-limit", "", argc, argv, i, value))
+        cpu_limit = std::strtoul(value.c_str(), nullptr, 10);
+    }
+    if (failed_first && results.empty())
+      results = ".ut_results";
+  }
+
+private:
+  static bool match(const std::string& arg, const std::string& name, const std::string& alias, int argc, char* argv[], int& i, std::string& value) {
+    for (const auto& flag : {name, alias}) {
+      if (flag.empty())
+        continue;
+      if (arg == flag) {
+        if (i + 1 < argc)
+          value = argv[++i];
+        return true;
+      }
+      auto prefix = (flag == name) ? flag + "=" : flag;
+      if (arg.size() > prefix.size() && arg.compare(0, prefix.size(), prefix) == 0) {
+        value = arg.substr(prefix.size());
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // a mistyped shard must not silently run everything on every machine
+  void parse_shard(const std::string& value) {
+    char* slash = nullptr;
+    auto i = std::strtoul(value.c_str(), &slash, 10);
+    auto n = (*slash == '/') ? std::strtoul(slash + 1, nullptr, 10) : 0;
+    if (i < 1 || i > n)
+      throw std::invalid_argument("--shard expects i/n with 1 <= i <= n, got " + value);
+    shard = i - 1;
+    shards = n;
+  }
+
+  static std::size_t count(const std::string& value) {
+    auto n = std::strtoul(value.c_str(), nullptr, 10);
+    if (n == 0)
+      n = std::thread::hardware_concurrency();
+    return (n == 0) ? 1 : n;
+  }
+
+  static double fraction(const std::string& value) {
+    char* suffix = nullptr;
+    double n = std::strtod(value.c_str(), &suffix);
+    return (*suffix == '%') ? n / 100 : n;
+  }
+
+  static std::size_t bytes(const std::string& value) {
+    char* suffix = nullptr;
+    std::size_t n = std::strtoull(value.c_str(), &suffix, 10);
+    switch(*suffix) {
+      case 'G': case 'g':
+        return n << 30;
+      case 'M': case 'm':
+        return n << 20;
+      case 'K': case 'k':
+        return n << 10;
+      default:
+        return n;
+    }
+  }
+};
+
+}
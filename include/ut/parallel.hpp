@@ -0,0 +1,63 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include <ut/heap.hpp>
+
+namespace ut {
+
+// fans the work of a single test out over threads of its own
+struct Parallel {
+  // calls work(i) for every i below n, on up to jobs threads, in order of i
+  // as far as each thread is concerned. what the helper threads allocate is
+  // added to the caller's figures once they are done, so the test accounts
+  // for all of it and blocks freed on another thread than their own don't
+  // look leaked; the peak is then an upper bound
+  template <typename Work>
+  static void each(std::size_t n, std::size_t jobs, const Work& work) {
+    std::atomic<std::size_t> next{0};
+    auto loop = [&]() {
+      for (auto i = next++; i < n; i = next++)
+        work(i);
+    };
+    auto helpers = (std::min(jobs, n) > 1) ? std::min(jobs, n) - 1 : 0;
+    std::vector<Heap::Counters> used(helpers);
+    std::vector<std::thread> threads;
+    threads.reserve(helpers);
+
+    // each thread's own state, which it frees after its figures are taken
+    auto& c = Heap::counters();
+    auto before = c;
+    for (std::size_t t = 0; t < helpers; ++t) {
+      threads.emplace_back([&, t]() {
+        loop();
+        used[t] = Heap::counters();
+      });
+    }
+    auto states = c.count - before.count;
+    auto state_bytes = c.live - before.live;
+
+    loop();
+    for (auto& t : threads)
+      t.join();
+
+    std::int64_t peaks = 0;
+    for (const auto& u : used) {
+      c.count += u.count;
+      c.frees += u.frees;
+      c.bytes += u.bytes;
+      c.live += u.live;
+      peaks += u.peak;
+    }
+    c.frees += states;
+    c.live -= state_bytes;
+    c.peak = std::max(c.peak, c.live + peaks);
+  }
+};
+
+}
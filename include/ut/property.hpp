@@ -0,0 +1,681 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <ut/assertions.hpp>
+#include <ut/diff.hpp>
+#include <ut/expect.hpp>
+#include <ut/parallel.hpp>
+
+namespace ut {
+
+// the choices a generated value is made of: drawn at random and recorded
+// while searching, replayed while shrinking. generators map smaller choices
+// to simpler values and 0 to the simplest, which replaying past the end of
+// the choices gives, so shrinking never has to know what it shrinks
+struct Source {
+  // thrown when a filter can't find a value it accepts
+  struct Reject {};
+
+  std::vector<std::uint64_t> choices;
+  // average length of generated collections, which grows with the case
+  std::size_t size = 0;
+
+  // at random
+  void reset(std::uint64_t seed, std::size_t size_) {
+    choices.clear();
+    replay = nullptr;
+    state = seed;
+    size = size_;
+  }
+
+  // the choices of an earlier case, or a smaller variation of them
+  void reset(const std::vector<std::uint64_t>& replay_) {
+    choices.clear();
+    replay = &replay_;
+    size = 0;
+  }
+
+  // a choice in [0, n]
+  std::uint64_t draw(std::uint64_t n) {
+    std::uint64_t v;
+    if (replay) {
+      v = (choices.size() < replay->size()) ? (*replay)[choices.size()] : 0;
+      v = std::min(v, n);
+    }
+    else {
+      v = pick(n);
+    }
+    choices.push_back(v);
+    return v;
+  }
+
+  // 1 with probability p
+  bool chance(double p) {
+    std::uint64_t v;
+    if (replay)
+      v = (choices.size() < replay->size() && (*replay)[choices.size()] != 0) ? 1 : 0;
+    else
+      v = (next() >> 11) < p * (1ull << 53) ? 1 : 0;
+    choices.push_back(v);
+    return v != 0;
+  }
+
+  // splitmix64: a few cycles a number, and any seed is a good one
+  std::uint64_t next() {
+    return mix(state += 0x9e3779b97f4a7c15ull);
+  }
+
+  static std::uint64_t mix(std::uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+  }
+
+private:
+  // uniform over a random number of bits, so small and large magnitudes are
+  // equally likely, with the bounds themselves drawn often
+  std::uint64_t pick(std::uint64_t n) {
+    auto r = next();
+    switch (r & 15) {
+      case 0:
+        return 0;
+      case 1:
+        return n;
+      default: {
+        auto bits = 1 + (r >> 4) % 64;
+        auto v = next() >> (64 - bits);
+        if (v <= n)
+          return v;
+        return (n == std::numeric_limits<std::uint64_t>::max()) ? v : v % (n + 1);
+      }
+    }
+  }
+
+  const std::vector<std::uint64_t>* replay = nullptr;
+  std::uint64_t state = 0;
+};
+
+namespace detail {
+
+template <std::size_t... I>
+struct indices {};
+
+template <std::size_t N, std::size_t... I>
+struct make_indices : make_indices<N - 1, N - 1, I...> {};
+
+template <std::size_t... I>
+struct make_indices<0, I...> {
+  typedef indices<I...> type;
+};
+
+}
+
+// the generator Gen::any<T>() returns; specialize it with a type and a
+// static make() to give user types one
+template <typename T, typename Enable = void>
+struct Arbitrary;
+
+// generators of test cases: each is a small value with a type and an
+// operator()(Source&) making one from the source's choices, so composing
+// them costs no indirection
+struct Gen {
+  template <typename T>
+  struct Integer {
+    typedef T type;
+    T lo, hi;
+
+    // towards 0, or the bound nearest to it
+    T operator()(Source& s) const {
+      typedef std::uint64_t U;
+      if (lo >= 0)
+        return static_cast<T>(static_cast<U>(lo) + s.draw(static_cast<U>(hi) - static_cast<U>(lo)));
+      if (hi <= 0)
+        return static_cast<T>(static_cast<U>(hi) - s.draw(static_cast<U>(hi) - static_cast<U>(lo)));
+      if (s.draw(1))
+        return static_cast<T>(U(0) - s.draw(U(0) - static_cast<U>(lo)));
+      return static_cast<T>(s.draw(static_cast<U>(hi)));
+    }
+  };
+
+  template <typename T>
+  struct Real {
+    typedef T type;
+    T lo, hi;
+
+    T operator()(Source& s) const {
+      const std::uint64_t steps = 1ull << 53;
+      if (lo >= 0)
+        return lo + (hi - lo) * (static_cast<T>(s.draw(steps)) / steps);
+      if (hi <= 0)
+        return hi - (hi - lo) * (static_cast<T>(s.draw(steps)) / steps);
+      if (s.draw(1))
+        return lo * (static_cast<T>(s.draw(steps)) / steps);
+      return hi * (static_cast<T>(s.draw(steps)) / steps);
+    }
+  };
+
+  // any finite value: the bits of a positive float order it by magnitude,
+  // so drawing them covers every exponent and shrinks towards 0
+  template <typename T>
+  struct Floating {
+    typedef T type;
+
+    T operator()(Source& s) const {
+      typedef typename std::conditional<sizeof(T) == sizeof(std::uint32_t), std::uint32_t, std::uint64_t>::type Bits;
+      static_assert(sizeof(T) == sizeof(Bits), "floats of 4 or 8 bytes");
+      T largest = std::numeric_limits<T>::max();
+      Bits top;
+      std::memcpy(&top, &largest, sizeof(top));
+      bool negative = s.draw(1) != 0;
+      auto bits = static_cast<Bits>(s.draw(top));
+      T value;
+      std::memcpy(&value, &bits, sizeof(value));
+      return negative ? -value : value;
+    }
+  };
+
+  struct Boolean {
+    typedef bool type;
+
+    bool operator()(Source& s) const {
+      return s.draw(1) != 0;
+    }
+  };
+
+  template <typename T>
+  struct Element {
+    typedef T type;
+    std::vector<T> values;
+
+    const T& operator()(Source& s) const {
+      return values[s.draw(values.size() - 1)];
+    }
+  };
+
+  // a coin before each element, rather than a length up front, lets
+  // shrinking drop any element and not just the last
+  template <typename C, typename G>
+  struct Collection {
+    typedef C type;
+    G element;
+    std::size_t min, max;
+
+    C operator()(Source& s) const {
+      C c;
+      double more = s.size / (s.size + 1.0);
+      for (std::size_t n = 0; n < max && (n < min || s.chance(more)); ++n)
+        c.insert(c.end(), element(s));
+      return c;
+    }
+  };
+
+  template <typename G, typename F>
+  struct Mapped {
+    typedef typename std::decay<decltype(std::declval<const F&>()(std::declval<typename G::type>()))>::type type;
+    G gen;
+    F f;
+
+    type operator()(Source& s) const {
+      return f(gen(s));
+    }
+  };
+
+  template <typename G, typename P>
+  struct Filtered {
+    typedef typename G::type type;
+    G gen;
+    P accept;
+
+    type operator()(Source& s) const {
+      for (int tries = 0; tries < 100; ++tries) {
+        auto value = gen(s);
+        if (accept(static_cast<const type&>(value)))
+          return value;
+      }
+      throw Source::Reject();
+    }
+  };
+
+  // braced initialization draws the parts in order
+  template <typename... G>
+  struct Tuple {
+    typedef std::tuple<typename G::type...> type;
+    std::tuple<G...> gens;
+
+    type operator()(Source& s) const {
+      return make(s, typename detail::make_indices<sizeof...(G)>::type());
+    }
+
+    template <std::size_t... I>
+    type make(Source& s, detail::indices<I...>) const {
+      return type{std::get<I>(gens)(s)...};
+    }
+  };
+
+  template <typename T, typename... G>
+  struct Build {
+    typedef T type;
+    std::tuple<G...> gens;
+
+    T operator()(Source& s) const {
+      return make(s, typename detail::make_indices<sizeof...(G)>::type());
+    }
+
+    template <std::size_t... I>
+    T make(Source& s, detail::indices<I...>) const {
+      return T{std::get<I>(gens)(s)...};
+    }
+  };
+
+  template <typename T>
+  static Integer<T> integer(T lo, T hi) {
+    return Integer<T>{lo, hi};
+  }
+
+  template <typename T>
+  static Real<T> real(T lo, T hi) {
+    return Real<T>{lo, hi};
+  }
+
+  static Boolean boolean() {
+    return Boolean();
+  }
+
+  static Integer<char> character(char lo = ' ', char hi = '~') {
+    return Integer<char>{lo, hi};
+  }
+
+  // one of the given values, shrinking towards the first
+  template <typename T>
+  static Element<T> element(std::initializer_list<T> values) {
+    return Element<T>{std::vector<T>(values)};
+  }
+
+  template <typename G>
+  static Collection<std::vector<typename G::type>, G> vector(const G& element, std::size_t max = 100, std::size_t min = 0) {
+    return Collection<std::vector<typename G::type>, G>{element, min, max};
+  }
+
+  // any container with insert(end, value), e.g. std::set or std::deque
+  template <typename C, typename G>
+  static Collection<C, G> container(const G& element, std::size_t max = 100, std::size_t min = 0) {
+    return Collection<C, G>{element, min, max};
+  }
+
+  static Collection<std::string, Integer<char>> string(std::size_t max = 100, std::size_t min = 0) {
+    return Collection<std::string, Integer<char>>{character(), min, max};
+  }
+
+  template <typename G>
+  static Collection<std::string, G> string(const G& character, std::size_t max = 100, std::size_t min = 0) {
+    return Collection<std::string, G>{character, min, max};
+  }
+
+  // shrinks through the value it was made from
+  template <typename G, typename F>
+  static Mapped<G, F> map(const G& gen, const F& f) {
+    return Mapped<G, F>{gen, f};
+  }
+
+  // cases no value is accepted for are rejected, not failed
+  template <typename G, typename P>
+  static Filtered<G, P> filter(const G& gen, const P& accept) {
+    return Filtered<G, P>{gen, accept};
+  }
+
+  template <typename... G>
+  static Tuple<G...> tuple(const G&... gens) {
+    return Tuple<G...>{std::tuple<G...>(gens...)};
+  }
+
+  // user types, brace initialized from the generated parts
+  template <typename T, typename... G>
+  static Build<T, G...> build(const G&... gens) {
+    return Build<T, G...>{std::tuple<G...>(gens...)};
+  }
+
+  // anything of T, see Arbitrary
+  template <typename T>
+  static typename Arbitrary<T>::type any();
+};
+
+template <typename T>
+struct Arbitrary<T, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value>::type> {
+  typedef Gen::Integer<T> type;
+
+  static type make() {
+    return Gen::integer(std::numeric_limits<T>::lowest(), std::numeric_limits<T>::max());
+  }
+};
+
+template <typename T>
+struct Arbitrary<T, typename std::enable_if<std::is_floating_point<T>::value>::type> {
+  typedef Gen::Floating<T> type;
+
+  static type make() {
+    return type();
+  }
+};
+
+template <>
+struct Arbitrary<bool> {
+  typedef Gen::Boolean type;
+
+  static type make() {
+    return type();
+  }
+};
+
+template <>
+struct Arbitrary<std::string> {
+  typedef Gen::Collection<std::string, Gen::Integer<char>> type;
+
+  static type make() {
+    return Gen::string();
+  }
+};
+
+template <typename T>
+struct Arbitrary<std::vector<T>> {
+  typedef Gen::Collection<std::vector<T>, typename Arbitrary<T>::type> type;
+
+  static type make() {
+    return Gen::vector(Arbitrary<T>::make());
+  }
+};
+
+template <typename A, typename B>
+struct Arbitrary<std::pair<A, B>> {
+  typedef Gen::Build<std::pair<A, B>, typename Arbitrary<A>::type, typename Arbitrary<B>::type> type;
+
+  static type make() {
+    return Gen::build<std::pair<A, B>>(Arbitrary<A>::make(), Arbitrary<B>::make());
+  }
+};
+
+template <typename... T>
+struct Arbitrary<std::tuple<T...>> {
+  typedef Gen::Tuple<typename Arbitrary<T>::type...> type;
+
+  static type make() {
+    return Gen::tuple(Arbitrary<T>::make()...);
+  }
+};
+
+template <typename T>
+typename Arbitrary<T>::type Gen::any() {
+  return Arbitrary<T>::make();
+}
+
+// how a property fared: the cases it ran, and how fast
+struct Cases {
+  std::size_t ran = 0;
+  // by filters, so neither passed nor failed
+  std::size_t rejected = 0;
+  // steps taken to the counterexample reported, if one was
+  std::size_t shrinks = 0;
+  std::uint64_t seed = 0;
+  // generating and checking cases, not shrinking
+  double seconds = 0;
+
+  double rate() const {
+    return (seconds > 0) ? ran / seconds : 0;
+  }
+};
+
+// runs a property over generated cases, cases() of them in blocks spread
+// over jobs threads: each case is seeded from the run's seed and its number,
+// so a case fails the same on any thread and the first failing case of a
+// run is always the same one. that case is then shrunk to a minimal
+// counterexample by replaying smaller choices while it keeps failing
+struct Properties {
+  struct Settings {
+    std::size_t cases = 10000;
+    std::size_t jobs = 1;
+    // 0 picks a seed per property, which failures report
+    std::uint64_t seed = 0;
+    // generated collections average 0 up to size - 1 elements
+    std::size_t size = 100;
+    // candidates tried while shrinking
+    std::size_t shrinks = 20000;
+  };
+
+  static Settings& settings() {
+    static Settings value;
+    return value;
+  }
+
+  enum class Verdict {
+    Pass,
+    Fail,
+    Reject
+  };
+
+  struct Failure {
+    std::string message;
+    std::string file;
+    std::size_t line = 0;
+    std::string func;
+
+    LocationInfo location() const {
+      return LocationInfo(file, line, func);
+    }
+
+    void located(const LocationInfo& l) {
+      file = l.file;
+      line = l.line;
+      func = l.func;
+    }
+  };
+
+  // a worker's source of cases and the expectations of the current one
+  struct Worker {
+    Source source;
+    Expectations expectations;
+  };
+
+  static std::uint64_t seed_of(std::uint64_t seed, std::size_t number) {
+    return Source::mix(seed + number * 0xd1b54a32d192ed03ull);
+  }
+
+  template <typename G, typename F>
+  static void run(const G& gen, const F& property, Cases& cases) {
+    cases = Cases();
+    cases.seed = settings().seed;
+    if (cases.seed == 0) {
+      std::random_device device;
+      cases.seed = device() | (static_cast<std::uint64_t>(device()) << 32);
+    }
+    const std::size_t total = settings().cases, block = 256;
+    const auto none = std::numeric_limits<std::size_t>::max();
+    std::atomic<std::size_t> first{none};
+    std::atomic<std::size_t> ran{0}, rejected{0};
+    std::vector<std::uint64_t> choices;
+    Failure failed;
+    std::mutex mutex;
+
+    auto start = std::chrono::steady_clock::now();
+    Parallel::each((total + block - 1) / block, std::max<std::size_t>(settings().jobs, 1), [&](std::size_t b) {
+      // cases after a known failure can't be the first
+      if (b * block >= first)
+        return;
+      Worker worker;
+      Expectations::Scope collecting(&worker.expectations);
+      Failure failure;
+      std::size_t n = b * block, end = std::min(total, n + block), passed = 0, skipped = 0;
+      for (; n < end; ++n) {
+        worker.source.reset(seed_of(cases.seed, n), n % std::max<std::size_t>(settings().size, 1));
+        auto verdict = check(gen, property, worker, failure);
+        if (UT_LIKELY(verdict == Verdict::Pass))
+          ++passed;
+        else if (verdict == Verdict::Reject)
+          ++skipped;
+        else
+          break;
+      }
+      ran += passed + skipped + (n < end ? 1 : 0);
+      rejected += skipped;
+      if (n == end)
+        return;
+      std::lock_guard<std::mutex> lock(mutex);
+      if (n < first) {
+        first = n;
+        choices = worker.source.choices;
+        failed = failure;
+      }
+    });
+    cases.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    cases.ran = ran;
+    cases.rejected = rejected;
+
+    if (first != none)
+      shrink(gen, property, choices, failed, first, cases);
+    if (cases.rejected == cases.ran && cases.ran > 0)
+      throw ut::Exception("all " + std::to_string(cases.ran) + " cases were rejected by filters", LocationInfo());
+  }
+
+  template <typename G, typename F>
+  static Verdict check(const G& gen, const F& property, Worker& worker, Failure& failure) {
+    try {
+      const auto& value = gen(worker.source);
+      bool held = holds(property, value);
+      if (UT_LIKELY(held && worker.expectations.empty()))
+        return Verdict::Pass;
+      failure = Failure();
+      if (!held)
+        failure.message = "property does not hold";
+      else
+        failure.located(worker.expectations.failures.front().location);
+    }
+    catch(Source::Reject&) {
+      worker.expectations.failures.clear();
+      return Verdict::Reject;
+    }
+    catch(ut::Exception& e) {
+      failure = Failure();
+      failure.message = e.what();
+      failure.located(e.location);
+    }
+    catch(std::exception& e) {
+      failure = Failure();
+      failure.message = e.what();
+    }
+    catch(...) {
+      failure = Failure();
+      failure.message = "unknown exception";
+    }
+    if (!worker.expectations.empty()) {
+      auto text = worker.expectations.str();
+      failure.message = failure.message.empty() ? text : text + "\n  " + failure.message;
+      worker.expectations.failures.clear();
+    }
+    return Verdict::Fail;
+  }
+
+  // properties either assert, or return whether they hold
+  template <typename F, typename T>
+  static auto holds(const F& property, const T& value) -> decltype(static_cast<bool>(property(value))) {
+    return static_cast<bool>(property(value));
+  }
+
+  template <typename F, typename T>
+  static auto holds(const F& property, const T& value) -> typename std::enable_if<std::is_void<decltype(property(value))>::value, bool>::type {
+    property(value);
+    return true;
+  }
+
+  // greedy passes over the choices, each kept only if the case still fails
+  // and the choices got shorter, or as short and smaller, which ends it
+  template <typename G, typename F>
+  static UT_COLD void shrink(const G& gen, const F& property, std::vector<std::uint64_t> best, Failure failure, std::size_t number, Cases& cases) {
+    Worker worker;
+    Expectations::Scope collecting(&worker.expectations);
+    // a case failing only now and then is reported as it first failed
+    Failure again;
+    worker.source.reset(best);
+    std::size_t budget = (check(gen, property, worker, again) == Verdict::Fail) ? settings().shrinks : 0;
+    auto fails = [&](const std::vector<std::uint64_t>& candidate) {
+      if (budget == 0)
+        return false;
+      --budget;
+      worker.source.reset(candidate);
+      Failure f;
+      if (check(gen, property, worker, f) != Verdict::Fail)
+        return false;
+      const auto& c = worker.source.choices;
+      if (c.size() > best.size() || (c.size() == best.size() && !(c < best)))
+        return false;
+      best = c;
+      failure = f;
+      ++cases.shrinks;
+      return true;
+    };
+
+    for (bool smaller = true; smaller && budget > 0;) {
+      smaller = false;
+      std::vector<std::uint64_t> candidate;
+      // without a run of choices, e.g. an element and its coin
+      for (std::size_t k : {8, 4, 2, 1}) {
+        for (std::size_t i = best.size(); i >= k; --i) {
+          if (i > best.size())
+            continue;
+          candidate.assign(best.begin(), best.begin() + (i - k));
+          candidate.insert(candidate.end(), best.begin() + i, best.end());
+          smaller = fails(candidate) || smaller;
+        }
+      }
+      // with a run of choices zeroed
+      for (std::size_t k : {8, 4, 2, 1}) {
+        for (std::size_t i = 0; i + k <= best.size(); ++i) {
+          if (std::all_of(best.begin() + i, best.begin() + i + k, [](std::uint64_t v) { return v == 0; }))
+            continue;
+          candidate = best;
+          std::fill(candidate.begin() + i, candidate.begin() + i + k, 0);
+          smaller = fails(candidate) || smaller;
+        }
+      }
+      // with each choice as small as it can be, found by bisection
+      for (std::size_t i = 0; i < best.size(); ++i) {
+        std::uint64_t lo = 0, hi = best[i];
+        while (lo < hi && i < best.size()) {
+          auto mid = lo + (hi - lo) / 2;
+          candidate = best;
+          candidate[i] = mid;
+          if (fails(candidate)) {
+            smaller = true;
+            hi = (i < best.size()) ? best[i] : 0;
+          }
+          else {
+            lo = mid + 1;
+          }
+        }
+      }
+    }
+
+    worker.source.reset(best);
+    auto value = gen(worker.source);
+    std::stringstream out;
+    out << "falsified after " << number + 1 << (number ? " cases" : " case") << " by " << Diff::show(value);
+    if (cases.shrinks > 0)
+      out << ", shrunk in " << cases.shrinks << (cases.shrinks > 1 ? " steps" : " step");
+    out << ", --seed " << cases.seed << " reproduces it: " << failure.message;
+    throw ut::Exception(out.str(), failure.location());
+  }
+};
+
+}
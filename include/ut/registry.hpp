@@ -16,6 +16,8 @@ namespace ut {
 
 struct Registry {
   static std::unordered_map<std::string, std::shared_ptr<Suite>>& registered() {
+    // the name table is created first, so it is destroyed after the tests
+    Names::names();
     static std::unordered_map<std::string, std::shared_ptr<Suite>> _impl;
     return _impl;
   };
@@ -30,10 +32,18 @@ struct Registry {
     auto parent = registered()[parent_name];
     auto current = registered().find(full);
 
+    // top level suites only record their initializer, see Suite::prepare
+    bool top = (parent_name == Registry::parent());
     if (current == registered().end()) {
       auto var = std::make_shared<Suite>(parent, name, full, cb);
       registered()[full] = var;
-      var->initialize();
+      if (top)
+        var->defer();
+      else
+        var->initialize();
+    }
+    else if (!current->second->deferred.empty()) {
+      current->second->deferred.push_back(cb);
     }
     else {
       current->second->initialize(cb);
@@ -41,8 +51,15 @@ struct Registry {
     return true;
   }
 
+  // nested suites only exist once their ancestors are initialized
   static std::shared_ptr<Suite> get(const std::string& name) {
     auto current = registered().find(name);
+    for (auto pos = name.find('/'); current == registered().end() && pos != std::string::npos; pos = name.find('/', pos + 1)) {
+      auto ancestor = registered().find(name.substr(0, pos));
+      if (ancestor != registered().end())
+        ancestor->second->prepare();
+      current = registered().find(name);
+    }
     if (current == registered().end())
       return nullptr;
     return current->second;
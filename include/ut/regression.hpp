@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <string>
+
+namespace ut {
+
+// a timing summary in nanoseconds; a plain test contributes a single sample,
+// a benchmark one per measured sample
+struct Measurement {
+  std::size_t samples = 0;
+  double mean = 0;
+  double stddev = 0;
+};
+
+// how a result compares against the same test in a baseline run
+struct Comparison {
+  double baseline = 0;
+  double current = 0;
+  // relative change of the mean, 0.1 being 10% slower
+  double delta = 0;
+  // one sided probability of a slowdown this large arising by chance, only
+  // computed when both sides have several samples
+  double p = 1;
+  bool regressed = false;
+  bool improved = false;
+
+  struct Thresholds {
+    // relative slowdown that counts as a regression
+    double threshold = 0.1;
+    // significance level for measurements with several samples
+    double alpha = 0.01;
+    // absolute slowdown, in microseconds, below which single samples are noise
+    double floor = 1000;
+  };
+
+  // slowdowns must be both large and unlikely to be noise: welch's t-test
+  // when both sides have samples to estimate their variance from, and an
+  // absolute floor otherwise
+  static Comparison between(const Measurement& before, const Measurement& after, const Thresholds& limits) {
+    Comparison c;
+    c.baseline = before.mean;
+    c.current = after.mean;
+    c.delta = (before.mean > 0) ? after.mean / before.mean - 1 : 0;
+
+    bool slower, faster;
+    if (before.samples > 1 && after.samples > 1) {
+      c.p = welch(before, after);
+      slower = c.p < limits.alpha;
+      faster = 1 - c.p < limits.alpha;
+    }
+    else {
+      slower = after.mean - before.mean > limits.floor * 1000;
+      faster = before.mean - after.mean > limits.floor * 1000;
+    }
+
+    c.regressed = slower && c.delta > limits.threshold;
+    c.improved = faster && c.delta < -limits.threshold;
+    return c;
+  }
+
+  // probability that after is not slower than before
+  static double welch(const Measurement& before, const Measurement& after) {
+    double v1 = before.stddev * before.stddev / before.samples;
+    double v2 = after.stddev * after.stddev / after.samples;
+    double se = std::sqrt(v1 + v2);
+    if (se == 0)
+      return (after.mean > before.mean) ? 0 : 1;
+
+    double t = (after.mean - before.mean) / se;
+    double df = (v1 + v2) * (v1 + v2) / (v1 * v1 / (before.samples - 1) + v2 * v2 / (after.samples - 1));
+    double tail = 0.5 * incomplete_beta(df / 2, 0.5, df / (df + t * t));
+    return (t > 0) ? tail : 1 - tail;
+  }
+
+  // regularized incomplete beta function I_x(a, b)
+  static double incomplete_beta(double a, double b, double x) {
+    if (x <= 0)
+      return 0;
+    if (x >= 1)
+      return 1;
+    double front = std::exp(std::lgamma(a + b) - std::lgamma(a) - std::lgamma(b) + a * std::log(x) + b * std::log(1 - x));
+    if (x < (a + 1) / (a + b + 2))
+      return front * continued_fraction(a, b, x) / a;
+    return 1 - front * continued_fraction(b, a, 1 - x) / b;
+  }
+
+  // lentz's method for the continued fraction of the incomplete beta function
+  static double continued_fraction(double a, double b, double x) {
+    const double tiny = 1e-300;
+    double c = 1;
+    double d = 1 - (a + b) * x / (a + 1);
+    d = 1 / ((std::fabs(d) < tiny) ? tiny : d);
+    double h = d;
+    for (int m = 1; m <= 200; ++m) {
+      double m2 = 2 * m;
+      double aa = m * (b - m) * x / ((a + m2 - 1) * (a + m2));
+      d = 1 + aa * d;
+      d = 1 / ((std::fabs(d) < tiny) ? tiny : d);
+      c = 1 + aa / c;
+      c = (std::fabs(c) < tiny) ? tiny : c;
+      h *= d * c;
+
+      aa = -(a + m) * (a + b + m) * x / ((a + m2) * (a + m2 + 1));
+      d = 1 + aa * d;
+      d = 1 / ((std::fabs(d) < tiny) ? tiny : d);
+      c = 1 + aa / c;
+      c = (std::fabs(c) < tiny) ? tiny : c;
+      double step = d * c;
+      h *= step;
+      if (std::fabs(step - 1) < 1e-12)
+        break;
+    }
+    return h;
+  }
+};
+
+}
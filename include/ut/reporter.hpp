@@ -10,6 +10,8 @@ struct Reporter {
   virtual void testFailed(const Test& t) {}
   virtual void testSucceeded(const Test& t) {}
   virtual void testStubbed(const Test& t) {}
+  // never started, since the run stopped early, see Options::max_failures
+  virtual void testCancelled(const Test& t) {}
   virtual void suiteStarted(const Suite& s) {}
   virtual void suiteFailed(const Suite& s) {}
   virtual void suiteSucceeded(const Suite& s) {}
@@ -0,0 +1,225 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <ostream>
+#include <streambuf>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include <ut/reporter.hpp>
+#include <ut/reporters/recording_reporter.hpp>
+#include <ut/suite.hpp>
+
+namespace ut {
+
+// an ostream over a duplicate of a file descriptor, written in large blocks;
+// duplicating it up front keeps the stream on the terminal while Capture
+// redirects the original descriptor around a test
+struct FileStream : std::ostream {
+  struct Buffer : std::streambuf {
+    Buffer(int fd_, std::size_t size)
+      : fd(dup(fd_)), data(size)
+    {
+      setp(data.data(), data.data() + data.size());
+    }
+
+    ~Buffer() {
+      sync();
+      close(fd);
+    }
+
+    int fd;
+    std::vector<char> data;
+
+    virtual int overflow(int c) {
+      if (sync() != 0)
+        return traits_type::eof();
+      if (c != traits_type::eof()) {
+        *pptr() = static_cast<char>(c);
+        pbump(1);
+      }
+      return traits_type::not_eof(c);
+    }
+
+    virtual int sync() {
+      const char* pos = pbase();
+      auto size = static_cast<std::size_t>(pptr() - pbase());
+      while (size > 0) {
+        auto n = ::write(fd, pos, size);
+        if (n < 0 && errno == EINTR)
+          continue;
+        if (n <= 0)
+          return -1;
+        pos += n;
+        size -= n;
+      }
+      setp(data.data(), data.data() + data.size());
+      return 0;
+    }
+  };
+
+  FileStream(int fd, std::size_t size = 1 << 16)
+    : std::ostream(nullptr), buffer(fd, size)
+  {
+    rdbuf(&buffer);
+  }
+
+  Buffer buffer;
+};
+
+// forwards events to another reporter on a dedicated writer thread, so
+// rendering and writing never hold up the tests; events pass through a
+// single producer, single consumer ring without locks
+//
+// the writer flushes out, the stream the wrapped reporter renders into, at
+// every suite end and whenever it catches up with the tests; the root suite
+// end, destruction and fatal signals wait until everything queued so far
+// has been written
+struct AsyncReporter : Reporter {
+  typedef RecordingReporter::Event Event;
+  typedef RecordingReporter::Record Record;
+
+  AsyncReporter(Reporter& inner_, std::ostream& out_)
+    : inner(inner_), out(out_), ring(capacity)
+  {
+    writer = std::thread([this]() { drain(); });
+    install(this);
+  }
+
+  ~AsyncReporter() {
+    barrier();
+    install(nullptr);
+    stopping = true;
+    writer.join();
+    out.flush();
+  }
+
+  AsyncReporter(const AsyncReporter&) = delete;
+  AsyncReporter& operator = (const AsyncReporter&) = delete;
+
+  virtual void testStarted(const Test& t) { push({Event::TestStarted, &t, nullptr}); }
+  virtual void testFailed(const Test& t) { push({Event::TestFailed, &t, nullptr}); }
+  virtual void testSucceeded(const Test& t) { push({Event::TestSucceeded, &t, nullptr}); }
+  virtual void testStubbed(const Test& t) { push({Event::TestStubbed, &t, nullptr}); }
+  virtual void testCancelled(const Test& t) { push({Event::TestCancelled, &t, nullptr}); }
+  virtual void suiteStarted(const Suite& s) { push({Event::SuiteStarted, nullptr, &s}); }
+
+  virtual void suiteFailed(const Suite& s) {
+    push({Event::SuiteFailed, nullptr, &s});
+    if (!s.parent)
+      barrier();
+  }
+
+  virtual void suiteSucceeded(const Suite& s) {
+    push({Event::SuiteSucceeded, nullptr, &s});
+    if (!s.parent)
+      barrier();
+  }
+
+  // waits until the writer has rendered and flushed every queued event
+  bool barrier(std::chrono::milliseconds timeout = std::chrono::hours(24)) {
+    if (std::this_thread::get_id() == writer.get_id())
+      return false;
+    auto target = head.load(std::memory_order_relaxed);
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (written.load(std::memory_order_acquire) < target) {
+      if (std::chrono::steady_clock::now() > deadline)
+        return false;
+      std::this_thread::yield();
+    }
+    return true;
+  }
+
+private:
+  static const std::size_t capacity = 1 << 12;
+
+  Reporter& inner;
+  std::ostream& out;
+  std::vector<Record> ring;
+  // events pushed, popped and fully handled, never wrapping around
+  std::atomic<std::size_t> head{0};
+  std::atomic<std::size_t> tail{0};
+  std::atomic<std::size_t> written{0};
+  std::atomic<bool> stopping{false};
+  std::thread writer;
+
+  void push(const Record& r) {
+    auto h = head.load(std::memory_order_relaxed);
+    while (h - tail.load(std::memory_order_acquire) == capacity)
+      std::this_thread::yield();
+    ring[h % capacity] = r;
+    head.store(h + 1, std::memory_order_release);
+  }
+
+  void drain() {
+    std::size_t idle = 0;
+    while (true) {
+      auto t = tail.load(std::memory_order_relaxed);
+      if (t == head.load(std::memory_order_acquire)) {
+        if (stopping)
+          return;
+        // back off from spinning to short sleeps while tests are running
+        if (++idle < 64)
+          std::this_thread::yield();
+        else
+          std::this_thread::sleep_for(std::chrono::microseconds(200));
+        continue;
+      }
+      idle = 0;
+
+      auto r = ring[t % capacity];
+      tail.store(t + 1, std::memory_order_release);
+      RecordingReporter::play(r, inner);
+      if (r.event == Event::SuiteFailed || r.event == Event::SuiteSucceeded || t + 1 == head.load(std::memory_order_acquire))
+        out.flush();
+      written.store(t + 1, std::memory_order_release);
+    }
+  }
+
+  static AsyncReporter*& active() {
+    static AsyncReporter* reporter = nullptr;
+    return reporter;
+  }
+
+  static struct sigaction* previous() {
+    static struct sigaction actions[NSIG];
+    return actions;
+  }
+
+  static const std::vector<int>& fatal() {
+    static const std::vector<int> signals = {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT};
+    return signals;
+  }
+
+  // best effort: get the events leading up to a crash out before dying
+  static void crash_handler(int sig) {
+    if (auto reporter = active())
+      reporter->barrier(std::chrono::milliseconds(1000));
+    sigaction(sig, &previous()[sig], nullptr);
+    raise(sig);
+  }
+
+  static void install(AsyncReporter* reporter) {
+    if (reporter && !active()) {
+      struct sigaction action;
+      std::memset(&action, 0, sizeof(action));
+      action.sa_handler = crash_handler;
+      sigemptyset(&action.sa_mask);
+      for (auto sig : fatal())
+        sigaction(sig, &action, &previous()[sig]);
+    }
+    else if (!reporter && active()) {
+      for (auto sig : fatal())
+        sigaction(sig, &previous()[sig], nullptr);
+    }
+    active() = reporter;
+  }
+};
+
+}
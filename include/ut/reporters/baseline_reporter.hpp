@@ -0,0 +1,170 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <ut/files.hpp>
+#include <ut/options.hpp>
+#include <ut/regression.hpp>
+#include <ut/reporter.hpp>
+#include <ut/suite.hpp>
+
+namespace ut {
+
+// compares every passing test and every suite total against a baseline file
+// saved by an earlier run, attaching the Comparison to the test or suite
+// before forwarding the event to the reporter it wraps; optionally saves this
+// run's timings as a new baseline once the root suite finishes
+//
+// baselines are text, one line per test or suite:
+//   kind<TAB>path<TAB>samples<TAB>mean ns<TAB>stddev ns
+struct BaselineReporter : Reporter {
+  BaselineReporter(Reporter& inner_, const Options& options)
+    : inner(inner_), save_path(options.save_baseline), limits(options.regression)
+  {
+    if (!options.baseline.empty())
+      baseline = load(options.baseline);
+  }
+
+  Reporter& inner;
+  std::string save_path;
+  Comparison::Thresholds limits;
+  std::map<std::string, Measurement> baseline;
+  std::map<std::string, Measurement> results;
+  // tests and suites slower than the baseline beyond the threshold,
+  // significantly so
+  std::size_t regressions = 0;
+
+  bool failed() const {
+    return regressions > 0;
+  }
+
+  static Measurement measure(const Test& t) {
+    const auto& result = t.result();
+    Measurement m;
+    if (result.statistics) {
+      m.samples = result.statistics->samples;
+      m.mean = result.statistics->mean;
+      m.stddev = result.statistics->stddev;
+    }
+    else {
+      m.samples = 1;
+      m.mean = result.seconds * 1e9;
+    }
+    return m;
+  }
+
+  virtual void testStarted(const Test& t) {
+    inner.testStarted(t);
+  }
+
+  virtual void testFailed(const Test& t) {
+    inner.testFailed(t);
+  }
+
+  virtual void testStubbed(const Test& t) {
+    inner.testStubbed(t);
+  }
+
+  virtual void testCancelled(const Test& t) {
+    inner.testCancelled(t);
+  }
+
+  virtual void suiteStarted(const Suite& s) {
+    open.push_back(&s);
+    inner.suiteStarted(s);
+  }
+
+  virtual void testSucceeded(const Test& t) {
+    auto& result = t.result();
+    auto key = "test\t" + Files::escape(open.empty() ? t.name : open.back()->path + "/" + t.name);
+    auto m = measure(t);
+    results[key] = m;
+    result.comparison = compare(key, m);
+    if (result.comparison && result.comparison->regressed)
+      ++regressions;
+    inner.testSucceeded(t);
+  }
+
+  virtual void suiteFailed(const Suite& s) {
+    finished(s);
+    inner.suiteFailed(s);
+  }
+
+  virtual void suiteSucceeded(const Suite& s) {
+    finished(s);
+    inner.suiteSucceeded(s);
+  }
+
+  // parses a baseline file, an absent one being empty
+  static std::map<std::string, Measurement> load(const std::string& path) {
+    std::map<std::string, Measurement> entries;
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line)) {
+      // the path is escaped, so the numbers are always the last three fields
+      auto c = line.rfind('\t');
+      auto b = (c == std::string::npos || c == 0) ? std::string::npos : line.rfind('\t', c - 1);
+      auto a = (b == std::string::npos || b == 0) ? std::string::npos : line.rfind('\t', b - 1);
+      if (a == std::string::npos)
+        continue;
+      Measurement m;
+      m.samples = std::strtoul(line.c_str() + a + 1, nullptr, 10);
+      m.mean = std::strtod(line.c_str() + b + 1, nullptr);
+      m.stddev = std::strtod(line.c_str() + c + 1, nullptr);
+      entries[line.substr(0, a)] = m;
+    }
+    return entries;
+  }
+
+  // tests a filtered run skipped keep their previous entries
+  void save() const {
+    auto entries = load(save_path);
+    for (const auto& r : results)
+      entries[r.first] = r.second;
+
+    std::stringstream out;
+    out << std::setprecision(12);
+    for (const auto& e : entries)
+      out << e.first << '\t' << e.second.samples << '\t' << e.second.mean << '\t' << e.second.stddev << '\n';
+    if (!Files::write(save_path, out.str()))
+      throw std::runtime_error("unable to write baseline " + save_path);
+  }
+
+private:
+  // suites being reported, innermost last
+  std::vector<const Suite*> open;
+
+  std::shared_ptr<Comparison> compare(const std::string& key, const Measurement& m) const {
+    auto found = baseline.find(key);
+    if (found == baseline.end())
+      return nullptr;
+    return std::make_shared<Comparison>(Comparison::between(found->second, m, limits));
+  }
+
+  void finished(const Suite& s) {
+    auto key = "suite\t" + Files::escape(s.path);
+    Measurement m;
+    m.samples = 1;
+    m.mean = s.microseconds * 1000.0;
+    results[key] = m;
+    s.comparison = compare(key, m);
+    if (s.comparison && s.comparison->regressed)
+      ++regressions;
+    if (!open.empty())
+      open.pop_back();
+
+    if (!s.parent && !save_path.empty())
+      save();
+  }
+};
+
+}
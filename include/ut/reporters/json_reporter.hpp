@@ -0,0 +1,164 @@
+#pragma once
+
+#include <cstdio>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <ut/reporter.hpp>
+#include <ut/suite.hpp>
+
+namespace ut {
+
+// streams one JSON object per line and event, so a run can be ingested
+// while it is still going, e.g.
+//   {"event":"test_failed","suite":"root/example1","test":"should fail","microseconds":12,...}
+struct JsonReporter : Reporter {
+  JsonReporter(std::ostream& out_)
+    : out(out_) {}
+
+  std::ostream& out;
+
+  virtual void suiteStarted(const Suite& s) {
+    open.push_back(&s);
+    out << "{\"event\":\"suite_started\",\"suite\":" << quote(s.path) << "}\n";
+  }
+
+  virtual void testStarted(const Test& t) {
+    begin("test_started", t);
+    out << "}\n";
+  }
+
+  virtual void testStubbed(const Test& t) {
+    begin("test_stubbed", t);
+    out << "}\n";
+  }
+
+  virtual void testCancelled(const Test& t) {
+    begin("test_cancelled", t);
+    out << "}\n";
+  }
+
+  virtual void testFailed(const Test& t) {
+    const auto& result = t.result();
+    begin("test_failed", t);
+    measured(t);
+    if (result.exception) {
+      const auto& location = result.exception->location;
+      out << ",\"message\":" << quote(result.exception->what());
+      out << ",\"location\":{\"file\":" << quote(location.file) << ",\"line\":" << location.line << ",\"function\":" << quote(location.func) << '}';
+      if (!result.exception->stack.empty())
+        out << ",\"stack\":" << quote(result.exception->stack.str());
+    }
+    else {
+      out << ",\"message\":" << quote(result.message);
+    }
+    output(t);
+    out << "}\n";
+  }
+
+  virtual void testSucceeded(const Test& t) {
+    const auto& result = t.result();
+    begin("test_succeeded", t);
+    measured(t);
+    if (result.statistics) {
+      const auto& s = *result.statistics;
+      out << ",\"statistics\":{\"samples\":" << s.samples << ",\"iterations\":" << s.iterations
+          << ",\"min\":" << s.min << ",\"median\":" << s.median << ",\"mean\":" << s.mean
+          << ",\"stddev\":" << s.stddev << ",\"p99\":" << s.p99 << '}';
+    }
+    output(t);
+    out << "}\n";
+  }
+
+  virtual void suiteFailed(const Suite& s) {
+    finished("suite_failed", s);
+  }
+
+  virtual void suiteSucceeded(const Suite& s) {
+    finished("suite_succeeded", s);
+  }
+
+  static std::string quote(const std::string& text) {
+    std::string quoted = "\"";
+    quoted.reserve(text.size() + 2);
+    for (auto c : text) {
+      switch(c) {
+        case '"': quoted += "\\\""; break;
+        case '\\': quoted += "\\\\"; break;
+        case '\n': quoted += "\\n"; break;
+        case '\r': quoted += "\\r"; break;
+        case '\t': quoted += "\\t"; break;
+        default:
+          if (static_cast<unsigned char>(c) < 0x20) {
+            char code[8];
+            std::snprintf(code, sizeof(code), "\\u%04x", c);
+            quoted += code;
+          }
+          else {
+            quoted += c;
+          }
+      }
+    }
+    return quoted + '"';
+  }
+
+private:
+  std::vector<const Suite*> open;
+
+  void begin(const char* event, const Test& t) {
+    out << "{\"event\":\"" << event << "\",\"suite\":" << quote(open.back()->path) << ",\"test\":" << quote(t.name);
+  }
+
+  // duration, heap traffic, and the rows or cases of a table or property
+  void measured(const Test& t) {
+    const auto& result = t.result();
+    out << ",\"microseconds\":" << result.microseconds;
+    if (result.allocations.measured) {
+      const auto& a = result.allocations;
+      out << ",\"allocations\":{\"count\":" << a.count << ",\"frees\":" << a.frees << ",\"bytes\":" << a.bytes
+          << ",\"peak\":" << a.peak << ",\"live\":" << a.live << '}';
+    }
+    // failing rows are keyed by number, which keeps every value an object
+    if (t.rows) {
+      const auto& r = *t.rows;
+      out << ",\"rows\":{\"total\":" << r.total << ",\"ran\":" << r.ran << ",\"passed\":" << r.passed << ",\"failed\":" << r.failed;
+      if (!r.failures.empty()) {
+        out << ",\"failures\":{";
+        for (std::size_t i = 0; i < r.failures.size(); ++i) {
+          const auto& f = r.failures[i];
+          out << (i ? "," : "") << '"' << f.row << "\":{\"message\":" << quote(f.message) << ",\"file\":" << quote(f.file)
+              << ",\"line\":" << f.line << ",\"function\":" << quote(f.func) << '}';
+        }
+        out << '}';
+      }
+      out << '}';
+    }
+    if (t.cases) {
+      const auto& c = *t.cases;
+      out << ",\"cases\":{\"ran\":" << c.ran << ",\"rejected\":" << c.rejected << ",\"shrinks\":" << c.shrinks
+          << ",\"seed\":" << c.seed << ",\"seconds\":" << c.seconds << '}';
+    }
+  }
+
+  void output(const Test& t) {
+    const auto& result = t.result();
+    if (!result.out.empty())
+      out << ",\"stdout\":" << quote(result.out);
+    if (!result.err.empty())
+      out << ",\"stderr\":" << quote(result.err);
+  }
+
+  void finished(const char* event, const Suite& s) {
+    out << "{\"event\":\"" << event << "\",\"suite\":" << quote(s.path) << ",\"failures\":" << s.failures
+        << ",\"successes\":" << s.successes << ",\"stubs\":" << s.stubs << ",\"cancelled\":" << s.cancelled << ",\"hook_failures\":" << s.hook_failures << ",\"microseconds\":" << s.microseconds;
+    if (s.exception)
+      out << ",\"message\":" << quote(s.exception->what());
+    out << "}\n";
+    open.pop_back();
+    if (open.empty())
+      out.flush();
+  }
+};
+
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <ut/reporter.hpp>
+#include <ut/suite.hpp>
+
+namespace ut {
+
+// streams JUnit XML as results arrive: every suite with tests of its own
+// becomes a flat <testsuite> named by its path, opened at its first test and
+// closed before the next suite starts, which works because a suite's tests
+// always run before its children; counts are left to the consumer, since
+// emitting them up front would mean buffering the whole tree
+struct JUnitReporter : Reporter {
+  JUnitReporter(std::ostream& out_)
+    : out(out_) {}
+
+  std::ostream& out;
+
+  virtual void suiteStarted(const Suite& s) {
+    close();
+    if (open.empty())
+      out << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<testsuites>\n";
+    open.push_back(&s);
+  }
+
+  virtual void testStubbed(const Test& t) {
+    testcase(t);
+    out << ">\n      <skipped message=\"stubbed\"/>\n    </testcase>\n";
+  }
+
+  virtual void testCancelled(const Test& t) {
+    testcase(t);
+    out << ">\n      <skipped message=\"cancelled\"/>\n    </testcase>\n";
+  }
+
+  virtual void testFailed(const Test& t) {
+    const auto& result = t.result();
+    testcase(t);
+    out << ">\n      <failure";
+    if (result.exception) {
+      out << " message=\"" << escape(result.exception->what()) << "\" type=\"ut::Exception\">";
+      const auto& location = result.exception->location;
+      if (!location.file.empty() || location.line > 0)
+        out << escape(location.file) << ':' << location.line << ' ' << escape(location.func) << '\n';
+      if (!result.exception->stack.empty())
+        out << escape(result.exception->stack.str());
+    }
+    else {
+      out << " message=\"" << escape(result.message) << "\">";
+    }
+    out << "</failure>\n";
+    output(t);
+    out << "    </testcase>\n";
+  }
+
+  virtual void testSucceeded(const Test& t) {
+    testcase(t);
+    if (t.result().out.empty() && t.result().err.empty()) {
+      out << "/>\n";
+      return;
+    }
+    out << ">\n";
+    output(t);
+    out << "    </testcase>\n";
+  }
+
+  virtual void suiteFailed(const Suite& s) {
+    finished(s);
+  }
+
+  virtual void suiteSucceeded(const Suite& s) {
+    finished(s);
+  }
+
+  // xml 1.0 cannot represent most control characters, even escaped
+  static std::string escape(const std::string& text) {
+    std::string escaped;
+    escaped.reserve(text.size());
+    for (auto c : text) {
+      switch(c) {
+        case '&': escaped += "&amp;"; break;
+        case '<': escaped += "&lt;"; break;
+        case '>': escaped += "&gt;"; break;
+        case '"': escaped += "&quot;"; break;
+        case '\'': escaped += "&apos;"; break;
+        case '\t': case '\n': case '\r': escaped += c; break;
+        default:
+          escaped += (static_cast<unsigned char>(c) < 0x20) ? '?' : c;
+      }
+    }
+    return escaped;
+  }
+
+private:
+  std::vector<const Suite*> open;
+  // the suite whose <testsuite> element is open, if any
+  const Suite* current = nullptr;
+
+  void testcase(const Test& t) {
+    const auto* suite = open.back();
+    if (current != suite) {
+      close();
+      out << "  <testsuite name=\"" << escape(suite->path) << "\">\n";
+      current = suite;
+    }
+    out << "    <testcase name=\"" << escape(t.name) << "\" classname=\"" << escape(suite->path) << "\" time=\"" << std::to_string(t.result().seconds) << '"';
+  }
+
+  void output(const Test& t) {
+    const auto& result = t.result();
+    if (!result.out.empty())
+      out << "      <system-out>" << escape(result.out) << "</system-out>\n";
+    if (!result.err.empty())
+      out << "      <system-err>" << escape(result.err) << "</system-err>\n";
+  }
+
+  void close() {
+    if (current)
+      out << "  </testsuite>\n";
+    current = nullptr;
+  }
+
+  void finished(const Suite&) {
+    close();
+    open.pop_back();
+    if (open.empty()) {
+      out << "</testsuites>\n";
+      out.flush();
+    }
+  }
+};
+
+}
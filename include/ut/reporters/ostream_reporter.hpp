@@ -6,6 +6,7 @@
 #include <unordered_map>
 #include <string>
 #include <sstream>
+#include <iomanip>
 
 #include <stdio.h>
 #include <unistd.h>
@@ -26,6 +27,7 @@ struct OstreamReporter : Reporter {
     failures_str = (utf8 ? "\u2717" : "failures:");
     stub_str = (utf8 ? "\u2126" : "stubbed");
     stubs_str = (utf8 ? "\u2126" : "stubs:");
+    cancelled_str = (utf8 ? "\u2298" : "cancelled:");
 
     newline_after_test = !compact;
     newline_after_suite_start = !compact;
@@ -36,6 +38,13 @@ struct OstreamReporter : Reporter {
     print_stdout = verbose;
     print_stderr = verbose;
     print_stack = verbose;
+    print_usage = verbose;
+
+    // resolved once, instead of per printed fragment
+    terminal = isatty(fileno(stdout));
+    static const char* names[] = {nullptr, "black", "red", "green", "yellow", "blue", "magenta", "cyan", "white"};
+    for (std::size_t i = 1; i < 9; ++i)
+      escapes[i] = "\u001b[" + std::to_string(color_map[names[i]] + attributes["foreground"]) + "m";
   }
 
   std::ostream& out;
@@ -43,6 +52,11 @@ struct OstreamReporter : Reporter {
   std::size_t indentation_size = 2;
 
   bool print_execution_time = true;
+  bool print_statistics = true;
+  bool print_usage = false;
+  // only once ut_track_allocations() is in place
+  bool print_allocations = true;
+  bool print_baseline = true;
   bool print_stack = false;
   bool print_location = true;
   bool print_stdout = false;
@@ -62,6 +76,7 @@ struct OstreamReporter : Reporter {
   std::string failures_str;
   std::string stub_str;
   std::string stubs_str;
+  std::string cancelled_str;
   std::string message_str;
   std::string location_str;
 
@@ -83,6 +98,11 @@ struct OstreamReporter : Reporter {
     {"background bright", 100}
   };
 
+  bool terminal = false;
+  // foreground escape sequence per Color
+  std::string escapes[9];
+  const std::string reset = "\u001b[0m";
+
   struct padding {
     int size = -1;
 
@@ -107,7 +127,7 @@ struct OstreamReporter : Reporter {
   }
 
   void endColor() {
-    out << "\u001b[0m";
+    out << reset;
   }
 
   enum class Color : std::uint8_t {
@@ -124,7 +144,7 @@ struct OstreamReporter : Reporter {
 
   // http://stackoverflow.com/questions/1312922/detect-if-stdin-is-a-terminal-or-pipe-in-c-c-qt
   bool isTerminal() {
-    return (isatty(fileno(stdout)));
+    return terminal;
   }
 
   void print_impl() {
@@ -151,71 +171,20 @@ struct OstreamReporter : Reporter {
 
   template <typename... Args>
   void print_impl(const Color& color, const Args&... args) {
-    if (isTerminal()) {
-      endColor();
-      switch(color) {
-        case Color::None:
-          break;
-        case Color::Black:
-          startColor("black");
-          break;
-        case Color::Red:
-          startColor("red");
-          break;
-        case Color::Green:
-          startColor("green");
-          break;
-        case Color::Yellow:
-          startColor("yellow");
-          break;
-        case Color::Blue:
-          startColor("blue");
-          break;
-        case Color::Magenta:
-          startColor("magenta");
-          break;
-        case Color::Cyan:
-          startColor("cyan");
-          break;
-        case Color::White:
-          startColor("white");
-          break;
-      }
-    }
+    if (terminal)
+      out << reset << escapes[static_cast<std::size_t>(color)];
     print_impl(args...);
   }
 
   template <typename... Args>
   void print(const Args&... args) {
-    if (isTerminal())
-      startColor("white");
+    if (terminal)
+      out << escapes[static_cast<std::size_t>(Color::White)];
     print_impl(args...);
-    if (isTerminal())
-      endColor();
+    if (terminal)
+      out << reset;
   }
 
-  // http://stackoverflow.com/questions/5419356/redirect-stdout-stderr-to-a-string
-  struct redirect {
-    redirect(std::ostream& buffer)
-      : _buffer(buffer), _old(buffer.rdbuf(_str.rdbuf()))
-    { }
-
-    std::string contents() {
-      return _str.str();
-    }
-
-    ~redirect( ) {
-      _buffer.rdbuf(_old);
-    }
-
-  private:
-    std::stringstream _str;
-    std::ostream& _buffer;
-    std::streambuf* _old;
-  };
-
-  std::vector<std::shared_ptr<redirect>> redirections;
-
   virtual void testStubbed(const Test& t) {
     print(pad(), Color::Yellow, Color::Cyan, t.name + ':');
     print((compact ? padding() : pad()), Color::Yellow, stub_str);
@@ -225,36 +194,40 @@ struct OstreamReporter : Reporter {
 
   virtual void testStarted(const Test& t) {
     print(pad(), Color::Yellow, Color::Cyan, t.name + ':');
-    redirections.emplace_back(std::make_shared<redirect>(std::cerr));
-    redirections.emplace_back(std::make_shared<redirect>(std::cout));
     increaseIndentation();
   }
 
   virtual void testFailed(const Test& t) {
-    auto stdout = redirections.back()->contents();
-    redirections.pop_back();
-    auto stderr = redirections.back()->contents();
-    redirections.pop_back();
-    bool us = (t.seconds < 0.001);
+    const auto& result = t.result();
+    bool us = (result.seconds < 0.001);
     print((compact ? padding() : pad()), Color::Red, failure_str);
     increaseIndentation();
     auto padding = compact ? -1 : pad();
-    if (t.exception) {
-      print(Color::Yellow, padding, message_str, Color::Red, t.exception->what());
-      if (print_location && !t.exception->location.empty())
-        print(Color::Yellow, padding, location_str, Color::Red, t.exception->location);
+    if (result.exception) {
+      print(Color::Yellow, padding, message_str, Color::Red, result.exception->what());
+      if (print_location && !result.exception->location.empty())
+        print(Color::Yellow, padding, location_str, Color::Red, result.exception->location);
     }
     else {
-      print(Color::Yellow, padding, message_str, Color::White, t.message);
+      print(Color::Yellow, padding, message_str, Color::White, result.message);
     }
     if (print_execution_time)
-      print(Color::Yellow, padding, execution_time_str, Color::White, (us) ? t.microseconds : t.seconds, (us) ? "(us)" : "(s)");
-    if (print_stdout && !stdout.empty())
-      print(Color::Yellow, padding, "stdout:", Color::White, stdout);
-    if (print_stderr && !stderr.empty())
-      print(Color::Yellow, padding, "stderr:", Color::White, stderr);
-    if (print_stack && t.exception)
-      print(Color::Yellow, padding, "stack:\n", Color::None, t.exception->stack);
+      print(Color::Yellow, padding, execution_time_str, Color::White, (us) ? result.microseconds : result.seconds, (us) ? "(us)" : "(s)");
+    // whatever a failure threw is still live, so leaks mean nothing here
+    if (print_allocations && result.allocations.measured)
+      printAllocations(padding, result.allocations, false);
+    if (t.rows)
+      printRows(padding, *t.rows);
+    if (t.cases)
+      printCases(padding, *t.cases);
+    if (print_usage)
+      printUsage(padding, result.usage);
+    if (print_stdout && !result.out.empty())
+      print(Color::Yellow, padding, "stdout:", Color::White, result.out);
+    if (print_stderr && !result.err.empty())
+      print(Color::Yellow, padding, "stderr:", Color::White, result.err);
+    if (print_stack && result.exception)
+      print(Color::Yellow, padding, "stack:\n", Color::None, result.exception->stack);
 
     decreaseIndentation();
     decreaseIndentation();
@@ -263,26 +236,120 @@ struct OstreamReporter : Reporter {
   }
 
   virtual void testSucceeded(const Test& t) {
-    auto stdout = redirections.back()->contents();
-    redirections.pop_back();
-    auto stderr = redirections.back()->contents();
-    redirections.pop_back();
-    bool us = (t.seconds < 0.001);
+    const auto& result = t.result();
+    bool us = (result.seconds < 0.001);
     print((compact ? padding() : pad()), Color::Green, success_str);
     increaseIndentation();
     auto padding = compact ? -1 : pad();
     if (print_execution_time)
-      print(Color::Yellow, padding, execution_time_str, Color::White, (us) ? t.microseconds : t.seconds, (us) ? "(us)" : "(s)");
-    if (print_stdout && !stdout.empty())
-      print(Color::Yellow, padding, "stdout:", Color::White, stdout);
-    if (print_stderr && !stderr.empty())
-      print(Color::Yellow, padding, "stderr:", Color::White, stderr);
+      print(Color::Yellow, padding, execution_time_str, Color::White, (us) ? result.microseconds : result.seconds, (us) ? "(us)" : "(s)");
+    if (print_allocations && result.allocations.measured)
+      printAllocations(padding, result.allocations, true);
+    if (t.rows)
+      printRows(padding, *t.rows);
+    if (t.cases)
+      printCases(padding, *t.cases);
+    if (print_usage)
+      printUsage(padding, result.usage);
+    if (print_statistics && result.statistics) {
+      const auto& s = *result.statistics;
+      print(Color::Yellow, padding, "mean:", Color::White, duration(s.mean), (utf8 ? "\u00b1" : "+/-"), duration(s.stddev));
+      print(Color::Yellow, padding, "median:", Color::White, duration(s.median), Color::Yellow, "min:", Color::White, duration(s.min), Color::Yellow, "p99:", Color::White, duration(s.p99));
+      print(Color::Yellow, padding, "throughput:", Color::White, rate(s.throughput()), Color::Yellow, "samples:", Color::White, s.samples, 'x', s.iterations);
+    }
+    if (print_baseline && result.comparison)
+      printComparison(padding, *result.comparison);
+    if (print_stdout && !result.out.empty())
+      print(Color::Yellow, padding, "stdout:", Color::White, result.out);
+    if (print_stderr && !result.err.empty())
+      print(Color::Yellow, padding, "stderr:", Color::White, result.err);
     decreaseIndentation();
     decreaseIndentation();
     if (newline_after_test)
       print('\n');
   }
 
+  void printUsage(const padding& padding, const Usage& u) {
+    print(Color::Yellow, padding, "cpu:", Color::White, duration(u.user_microseconds * 1000.0), "user", duration(u.system_microseconds * 1000.0), "sys");
+    print(Color::Yellow, "switches:", Color::White, u.voluntary_switches, "voluntary", u.involuntary_switches, "involuntary");
+    print(Color::Yellow, "faults:", Color::White, u.minor_faults, "minor", u.major_faults, "major");
+    print(Color::Yellow, "rss:", Color::White, '+' + std::to_string(u.max_rss_delta) + "KB");
+  }
+
+  void printAllocations(const padding& padding, const Allocations& a, bool leaks, const char* label = "allocations:") {
+    print(Color::Yellow, padding, label, Color::White, a.count, '(' + size(a.bytes) + ')', Color::Yellow, "peak:", Color::White, size(a.peak));
+    if (leaks && a.leaked())
+      print(Color::Red, "leaked:", a.blocks(), '(' + size(a.live) + ')');
+  }
+
+  // counts, then each failing row kept on a line of its own
+  void printRows(const padding& padding, const Rows& r) {
+    print(Color::Yellow, padding, "rows:", Color::Green, successes_str, r.passed);
+    if (r.failed > 0)
+      print(Color::Red, failures_str, r.failed);
+    if (r.ran < r.total)
+      print(Color::Yellow, "of", Color::White, r.total);
+    for (const auto& f : r.failures) {
+      print(Color::Yellow, pad(), "row " + std::to_string(f.row) + ':', Color::Red, f.message);
+      if (print_location && !f.file.empty())
+        print(Color::Red, f.location());
+    }
+    if (r.failures.size() < r.failed)
+      print(Color::Yellow, pad(), "...", r.failed - r.failures.size(), "more");
+  }
+
+  // throughput, to size --cases to the time a run can take
+  void printCases(const padding& padding, const Cases& c) {
+    print(Color::Yellow, padding, "cases:", Color::White, c.ran, Color::Yellow, "rate:", Color::White, rate(c.rate()));
+    if (c.rejected > 0)
+      print(Color::Yellow, "rejected:", Color::White, c.rejected);
+  }
+
+  void printComparison(const padding& padding, const Comparison& c) {
+    auto color = c.regressed ? Color::Red : (c.improved ? Color::Green : Color::White);
+    std::stringstream delta;
+    delta << std::showpos << std::fixed << std::setprecision(1) << c.delta * 100 << '%';
+    print(Color::Yellow, padding, "baseline:", Color::White, duration(c.baseline), color, delta.str());
+    if (c.p < 1)
+      print(Color::Yellow, "p:", Color::White, c.p);
+    if (c.regressed)
+      print(Color::Red, "regression");
+  }
+
+  static std::string duration(double ns) {
+    static const char* units[] = {"ns", "us", "ms", "s"};
+    return scaled(ns, 1000, units, 4);
+  }
+
+  static std::string size(double bytes) {
+    static const char* units[] = {"B", "KB", "MB", "GB"};
+    return scaled(bytes, 1024, units, 4);
+  }
+
+  static std::string rate(double per_second) {
+    static const char* units[] = {"", "K", "M", "G"};
+    return scaled(per_second, 1000, units, 4) + "/s";
+  }
+
+  // about three significant digits in fixed notation, so 1000 to 1023
+  // bytes never turn into 1e+03, and 999.7ns reads 1us
+  static std::string scaled(double value, double step, const char* const* units, std::size_t n) {
+    std::size_t unit = 0;
+    while (value + 0.5 >= step && unit + 1 < n) {
+      value /= step;
+      ++unit;
+    }
+    std::stringstream str;
+    str << std::fixed << std::setprecision(value >= 100 ? 0 : (value >= 10 ? 1 : 2)) << value;
+    auto s = str.str();
+    if (s.find('.') != std::string::npos) {
+      s.erase(s.find_last_not_of('0') + 1);
+      if (s.back() == '.')
+        s.pop_back();
+    }
+    return s + units[unit];
+  }
+
   virtual void suiteStarted(const Suite& s) {
     if(s.name == "root") {
       print(Color::Yellow, Color::Blue, s.name + ':');
@@ -301,15 +368,31 @@ struct OstreamReporter : Reporter {
     print(pad(), Color::Blue, s.name + " results:");
     increaseIndentation();
     auto padding = compact ? -1 : pad();
-    print(Color::Yellow, padding, failures_str, Color::Red, s.failures);
+    if (s.failures || !s.hook_failures)
+      print(Color::Yellow, padding, failures_str, Color::Red, s.failures);
     if (s.successes)
       print(Color::Yellow, padding, successes_str, Color::Green, s.successes);
     if (s.stubs)
       print(Color::Yellow, padding, stubs_str, Color::Blue, s.stubs);
+    if (s.cancelled)
+      print(Color::Yellow, padding, cancelled_str, Color::Magenta, s.cancelled);
+    if (s.hook_failures)
+      print(Color::Yellow, padding, "hook failures:", Color::Red, s.hook_failures);
+    if (s.exception) {
+      print(Color::Yellow, padding, message_str, Color::Red, s.exception->what());
+      if (print_location && !s.exception->location.empty())
+        print(Color::Yellow, padding, location_str, Color::Red, s.exception->location);
+      if (print_stack)
+        print(Color::Yellow, padding, "stack:\n", Color::None, s.exception->stack);
+    }
     if (print_execution_time) {
       bool us = (s.microseconds < 1000);
       print(Color::Yellow, padding, execution_time_str, Color::White, (us) ? s.microseconds : s.microseconds / 1000000.0, (us) ? "(us)" : "(s)");
     }
+    if (print_allocations && s.hooks.count > 0)
+      printAllocations(padding, s.hooks, false, "hook allocations:");
+    if (print_baseline && s.comparison)
+      printComparison(padding, *s.comparison);
     decreaseIndentation();
     if (newline_after_suite_end && s.name != "root")
       print('\n');
@@ -323,10 +406,16 @@ struct OstreamReporter : Reporter {
     print(Color::Yellow, padding, successes_str, Color::Green, s.successes);
     if (s.stubs)
       print(Color::Yellow, padding, stubs_str, Color::Blue, s.stubs);
+    if (s.cancelled)
+      print(Color::Yellow, padding, cancelled_str, Color::Magenta, s.cancelled);
     if (print_execution_time) {
       bool us = (s.microseconds < 1000);
       print(Color::Yellow, padding, execution_time_str, Color::White, (us) ? s.microseconds : s.microseconds / 1000000.0, (us) ? "(us)" : "(s)");
     }
+    if (print_allocations && s.hooks.count > 0)
+      printAllocations(padding, s.hooks, false, "hook allocations:");
+    if (print_baseline && s.comparison)
+      printComparison(padding, *s.comparison);
     decreaseIndentation();
     if (newline_after_suite_end && s.name != "root")
       print('\n');
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <vector>
+
+#include <ut/reporter.hpp>
+
+namespace ut {
+
+// buffers reporter events so that suites executed on other threads can be
+// replayed to the real reporter in tree order
+struct RecordingReporter : Reporter {
+  enum class Event {
+    TestStarted,
+    TestFailed,
+    TestSucceeded,
+    TestStubbed,
+    TestCancelled,
+    SuiteStarted,
+    SuiteFailed,
+    SuiteSucceeded
+  };
+
+  struct Record {
+    Event event;
+    const Test* test;
+    const Suite* suite;
+  };
+
+  std::vector<Record> records;
+
+  template <typename Target>
+  void replay(Target& target) const {
+    for (const auto& r : records)
+      play(r, target);
+  }
+
+  template <typename Target>
+  static void play(const Record& r, Target& target) {
+    switch(r.event) {
+      case Event::TestStarted:
+        target.testStarted(*r.test);
+        break;
+      case Event::TestFailed:
+        target.testFailed(*r.test);
+        break;
+      case Event::TestSucceeded:
+        target.testSucceeded(*r.test);
+        break;
+      case Event::TestStubbed:
+        target.testStubbed(*r.test);
+        break;
+      case Event::TestCancelled:
+        target.testCancelled(*r.test);
+        break;
+      case Event::SuiteStarted:
+        target.suiteStarted(*r.suite);
+        break;
+      case Event::SuiteFailed:
+        target.suiteFailed(*r.suite);
+        break;
+      case Event::SuiteSucceeded:
+        target.suiteSucceeded(*r.suite);
+        break;
+    }
+  }
+
+  virtual void testStarted(const Test& t) { records.push_back({Event::TestStarted, &t, nullptr}); }
+  virtual void testFailed(const Test& t) { records.push_back({Event::TestFailed, &t, nullptr}); }
+  virtual void testSucceeded(const Test& t) { records.push_back({Event::TestSucceeded, &t, nullptr}); }
+  virtual void testStubbed(const Test& t) { records.push_back({Event::TestStubbed, &t, nullptr}); }
+  virtual void testCancelled(const Test& t) { records.push_back({Event::TestCancelled, &t, nullptr}); }
+  virtual void suiteStarted(const Suite& s) { records.push_back({Event::SuiteStarted, nullptr, &s}); }
+  virtual void suiteFailed(const Suite& s) { records.push_back({Event::SuiteFailed, nullptr, &s}); }
+  virtual void suiteSucceeded(const Suite& s) { records.push_back({Event::SuiteSucceeded, nullptr, &s}); }
+};
+
+}
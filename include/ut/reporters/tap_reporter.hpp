@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <ut/reporter.hpp>
+#include <ut/suite.hpp>
+
+namespace ut {
+
+// streams TAP version 13: one numbered line per test named by its full
+// path, stubs as skips, failure details in a yaml block below the line, and
+// the plan at the end, once the number of tests is known
+struct TapReporter : Reporter {
+  TapReporter(std::ostream& out_)
+    : out(out_) {}
+
+  std::ostream& out;
+
+  virtual void suiteStarted(const Suite& s) {
+    if (open.empty())
+      out << "TAP version 13\n";
+    open.push_back(&s);
+    out << "# " << line(s.path) << '\n';
+  }
+
+  virtual void testStubbed(const Test& t) {
+    out << "ok " << ++count << " - " << name(t) << " # SKIP stubbed\n";
+  }
+
+  virtual void testCancelled(const Test& t) {
+    out << "ok " << ++count << " - " << name(t) << " # SKIP cancelled\n";
+  }
+
+  virtual void testFailed(const Test& t) {
+    const auto& result = t.result();
+    out << "not ok " << ++count << " - " << name(t) << "\n  ---\n";
+    if (result.exception) {
+      const auto& location = result.exception->location;
+      out << "  message: " << block(result.exception->what());
+      if (!location.file.empty() || location.line > 0) {
+        out << "  at: " << block(location.file + ':' + std::to_string(location.line));
+        out << "  function: " << block(location.func);
+      }
+      if (!result.exception->stack.empty())
+        out << "  stack: " << block(result.exception->stack.str());
+    }
+    else {
+      out << "  message: " << block(result.message);
+    }
+    out << "  duration_ms: " << result.microseconds / 1000.0 << '\n';
+    if (!result.out.empty())
+      out << "  stdout: " << block(result.out);
+    if (!result.err.empty())
+      out << "  stderr: " << block(result.err);
+    out << "  ...\n";
+  }
+
+  virtual void testSucceeded(const Test& t) {
+    out << "ok " << ++count << " - " << name(t) << " # time=" << t.result().microseconds / 1000.0 << "ms\n";
+  }
+
+  virtual void suiteFailed(const Suite& s) {
+    // a failed before or after hook is a point of its own
+    if (s.exception)
+      out << "not ok " << ++count << " - " << line(s.path) << "\n  ---\n  message: " << block(s.exception->what()) << "  ...\n";
+    finished(s);
+  }
+
+  virtual void suiteSucceeded(const Suite& s) {
+    finished(s);
+  }
+
+private:
+  std::vector<const Suite*> open;
+  std::size_t count = 0;
+
+  // descriptions must stay on their line, and a # would start a directive
+  static std::string line(const std::string& text) {
+    std::string escaped;
+    for (auto c : text) {
+      if (c == '\n' || c == '\r')
+        escaped += ' ';
+      else if (c == '#')
+        escaped += "\\#";
+      else
+        escaped += c;
+    }
+    return escaped;
+  }
+
+  std::string name(const Test& t) const {
+    return line(open.back()->path + "/" + t.name);
+  }
+
+  // a yaml literal block, indented below its key
+  static std::string block(const std::string& text) {
+    std::string yaml = "|-\n    ";
+    for (auto c : text) {
+      yaml += c;
+      if (c == '\n')
+        yaml += "    ";
+    }
+    return yaml + '\n';
+  }
+
+  void finished(const Suite&) {
+    open.pop_back();
+    if (open.empty()) {
+      out << "1.." << count << '\n';
+      out.flush();
+      count = 0;
+    }
+  }
+};
+
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include <ut/files.hpp>
+
+namespace ut {
+
+// outcomes and durations of earlier runs, kept per test and suite so the
+// next run can start with what failed last time and schedule the longest
+// work first; tests a run skips keep their previous entries
+//
+// results are text, one line per test or suite:
+//   passed|failed|suite<TAB>microseconds<TAB>path
+struct Results {
+  struct Entry {
+    bool failed = false;
+    // smoothed over recent runs, 0 when never measured
+    double microseconds = 0;
+  };
+
+  std::map<std::string, Entry> entries;
+  std::map<std::string, double> suites;
+
+  static std::string key(const std::string& path, const std::string& name) {
+    return Files::escape(path + "/" + name);
+  }
+
+  const Entry* find(const std::string& path, const std::string& name) const {
+    auto found = entries.find(key(path, name));
+    return (found == entries.end()) ? nullptr : &found->second;
+  }
+
+  bool failed(const std::string& path, const std::string& name) const {
+    auto entry = find(path, name);
+    return entry && entry->failed;
+  }
+
+  // what a test without history is expected to take: the mean of the ones
+  // with history
+  double typical() const {
+    double total = 0;
+    std::size_t n = 0;
+    for (const auto& e : entries) {
+      if (e.second.microseconds > 0) {
+        total += e.second.microseconds;
+        ++n;
+      }
+    }
+    return (n == 0) ? 0 : total / n;
+  }
+
+  double suite(const std::string& path) const {
+    auto found = suites.find(Files::escape(path));
+    return (found == suites.end()) ? 0 : found->second;
+  }
+
+  void record(const std::string& path, const std::string& name, bool failed, double microseconds) {
+    auto& entry = entries[key(path, name)];
+    entry.failed = failed;
+    entry.microseconds = smooth(entry.microseconds, microseconds);
+  }
+
+  void record(const std::string& path, double microseconds) {
+    auto& entry = suites[Files::escape(path)];
+    entry = smooth(entry, microseconds);
+  }
+
+  // an absent file holds no results
+  static Results load(const std::string& file) {
+    Results results;
+    std::ifstream in(file);
+    std::string line;
+    while (std::getline(in, line)) {
+      // the path is escaped, so it is always the last field
+      auto first = line.find('\t');
+      auto last = line.rfind('\t');
+      if (first == std::string::npos)
+        continue;
+      auto kind = line.substr(0, first);
+      auto path = line.substr(last + 1);
+      double microseconds = (first == last) ? 0 : std::strtod(line.c_str() + first + 1, nullptr);
+      if (kind == "suite") {
+        results.suites[path] = microseconds;
+      }
+      else {
+        auto& entry = results.entries[path];
+        entry.failed = (kind == "failed");
+        entry.microseconds = microseconds;
+      }
+    }
+    return results;
+  }
+
+  void save(const std::string& file) const {
+    std::stringstream out;
+    for (const auto& e : entries)
+      out << (e.second.failed ? "failed" : "passed") << '\t' << e.second.microseconds << '\t' << e.first << '\n';
+    for (const auto& s : suites)
+      out << "suite\t" << s.second << '\t' << s.first << '\n';
+    if (!Files::write(file, out.str()))
+      throw std::runtime_error("unable to write results " + file);
+  }
+
+private:
+  // halves the weight of older runs, so one noisy run never dominates
+  static double smooth(double previous, double current) {
+    return (previous > 0) ? (previous + current) / 2 : current;
+  }
+};
+
+}
@@ -0,0 +1,264 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <ut/filter.hpp>
+#include <ut/isolation.hpp>
+#include <ut/merge.hpp>
+#include <ut/options.hpp>
+#include <ut/property.hpp>
+#include <ut/results.hpp>
+#include <ut/snapshot.hpp>
+#include <ut/suite.hpp>
+#include <ut/table.hpp>
+#include <ut/thread_pool.hpp>
+
+namespace ut {
+
+// runs a tree the way the command line asks: the process-wide settings are
+// applied once, then the plan is ordered and sharded by the results of
+// earlier runs, and executed in process, on threads, in isolated workers,
+// or merged from the shards of a run
+struct Runner {
+  typedef Suite::Plan Plan;
+
+  // the settings options stand for, applied before anything runs
+  static void apply(const Options& options) {
+    Executor::instance().concurrency(options.async_jobs);
+    SymbolCache::instance().background = options.background_symbols;
+    Benchmark::settings() = options.benchmark;
+    Usage::enabled() = options.usage;
+    // suites running on threads would interleave in the shared descriptors
+    Capture::enabled() = options.capture && (options.isolate || options.jobs <= 1);
+    Capture::limit() = options.capture_limit;
+    Capture::warm();
+    Watchdog::default_limit() = std::chrono::milliseconds(static_cast<std::int64_t>(options.timeout * 1000));
+    Snapshots::settings().directory = options.snapshots;
+    Snapshots::settings().update = options.update_snapshots;
+    Tables::settings().jobs = options.jobs;
+    Tables::settings().rows = options.rows;
+    Properties::settings().jobs = options.jobs;
+    Properties::settings().cases = options.cases;
+    Properties::settings().seed = options.seed;
+    if (options.tsc && !tsc::enabled())
+      tsc::enable();
+  }
+
+  template <typename Reporter>
+  static void execute(const Suite& root, Reporter& reporter, const Options& options) {
+    auto selection = root.plan(Filter(options.filter));
+
+    Results results;
+    if (!options.results.empty())
+      results = Results::load(options.results);
+    auto typical = results.typical();
+    estimate(selection, results, typical);
+    if (options.shards > 1 && options.merge.empty()) {
+      shard(selection, options.shard, options.shards, typical > 0);
+      estimate(selection, results, typical);
+    }
+    if (options.failed_first)
+      prioritize(selection, results);
+
+    std::atomic<std::size_t> failed{0};
+    Suite::Context context;
+    context.failures = &failed;
+    context.max_failures = options.max_failures;
+    if (!options.merge.empty()) {
+      std::unordered_map<std::string, const Test*> tests;
+      index(selection, tests);
+      Merge::load(options.merge, tests);
+      context.merged = true;
+      root.execute(reporter, selection, context);
+    }
+    else if (options.isolate) {
+      std::vector<const Plan*> jobs;
+      std::vector<std::vector<const Test*>> tests;
+      Suite::collect(selection, jobs, tests);
+
+      ProcessPool processes(options, tests, [&jobs](std::size_t job, std::size_t first, ProcessPool::Channel& channel) {
+        jobs[job]->suite->run_isolated(*jobs[job], first, channel);
+      });
+      processes.schedule(Suite::schedule(jobs.size(), [&jobs](std::size_t i) {
+        return std::make_pair(jobs[i]->failing, jobs[i]->own);
+      }));
+      context.processes = &processes;
+      root.execute(reporter, selection, context);
+    }
+    else if (options.jobs > 1) {
+      ThreadPool pool(options.jobs);
+      context.pool = &pool;
+      root.execute(reporter, selection, context);
+    }
+    else {
+      root.execute(reporter, selection, context);
+    }
+
+    if (!options.results.empty()) {
+      record(selection, results);
+      results.save(options.results);
+    }
+  }
+
+  // moves the tests that failed in an earlier run ahead of the rest of their
+  // suite, and suites holding any ahead of their siblings; returns whether
+  // the plan holds any
+  static bool prioritize(Plan& p, const Results& previous) {
+    const auto& suite = *p.suite;
+    auto failing = std::stable_partition(p.tests.begin(), p.tests.end(), [&](std::size_t i) {
+      return previous.failed(suite.path, suite.tests[i].name);
+    });
+
+    std::vector<Plan> first;
+    std::vector<Plan> rest;
+    for (auto& s : p.suites) {
+      if (prioritize(s, previous))
+        first.push_back(std::move(s));
+      else
+        rest.push_back(std::move(s));
+    }
+    p.suites = std::move(first);
+    for (auto& s : rest)
+      p.suites.push_back(std::move(s));
+
+    p.failing = failing != p.tests.begin() || p.suites.size() > rest.size();
+    return p.failing;
+  }
+
+  // expected durations from earlier runs: tests without history count as
+  // typical, and a subtree none of whose tests have any falls back on the
+  // suite's own history; returns whether any test had history
+  static bool estimate(Plan& p, const Results& previous, double typical) {
+    const auto& suite = *p.suite;
+    bool known = false;
+    p.own = 0;
+    for (auto i : p.tests) {
+      const auto& test = suite.tests[i];
+      if (test.is_stub)
+        continue;
+      auto entry = previous.find(suite.path, test.name);
+      known = known || (entry && entry->microseconds > 0);
+      p.own += (entry && entry->microseconds > 0) ? entry->microseconds : typical;
+    }
+
+    p.total = p.own;
+    for (auto& s : p.suites) {
+      known = estimate(s, previous, typical) || known;
+      p.total += s.total;
+    }
+
+    if (!known && previous.suite(suite.path) > 0)
+      p.total = previous.suite(suite.path);
+    return known;
+  }
+
+  // a part of the plan that always runs on the same shard: a suite's own
+  // tests, or its whole subtree when it has before or after hooks, whose
+  // effects nested suites may rely on
+  struct Unit {
+    Plan* plan;
+    bool subtree;
+    double cost;
+  };
+
+  // splits the plan into units costing their expected duration, or their
+  // number of tests without history
+  static void units(Plan& p, bool durations, std::vector<Unit>& out) {
+    const auto& suite = *p.suite;
+    if (!suite._before.empty() || !suite._after.empty()) {
+      out.push_back({&p, true, durations ? p.total : static_cast<double>(count(p))});
+      return;
+    }
+    if (!p.tests.empty())
+      out.push_back({&p, false, durations ? p.own : static_cast<double>(count(p.suite->tests, p.tests))});
+    for (auto& s : p.suites)
+      units(s, durations, out);
+  }
+
+  static std::size_t count(const std::deque<Test>& tests, const std::vector<std::size_t>& selected) {
+    std::size_t n = 0;
+    for (auto i : selected)
+      n += tests[i].is_stub ? 0 : 1;
+    return n;
+  }
+
+  static std::size_t count(const Plan& p) {
+    auto n = count(p.suite->tests, p.tests);
+    for (const auto& s : p.suites)
+      n += count(s);
+    return n;
+  }
+
+  // keeps the units of one of several shards: each unit, longest first,
+  // goes to the least loaded shard, which every shard computes alike as
+  // long as they share the tree and the history
+  static void shard(Plan& p, std::size_t index, std::size_t shards, bool durations) {
+    std::vector<Unit> all;
+    units(p, durations, all);
+    auto order = Suite::schedule(all.size(), [&all](std::size_t i) {
+      return all[i].cost;
+    });
+
+    std::vector<double> load(shards, 0);
+    for (auto i : order) {
+      auto least = std::min_element(load.begin(), load.end()) - load.begin();
+      load[least] += all[i].cost;
+      if (static_cast<std::size_t>(least) == index)
+        continue;
+      all[i].plan->tests.clear();
+      if (all[i].subtree)
+        all[i].plan->suites.clear();
+    }
+    prune(p);
+  }
+
+  // drops child plans left without tests; returns whether p has any
+  static bool prune(Plan& p) {
+    std::vector<Plan> kept;
+    for (auto& s : p.suites) {
+      if (prune(s))
+        kept.push_back(std::move(s));
+    }
+    p.suites = std::move(kept);
+    return !p.tests.empty() || !p.suites.empty();
+  }
+
+  // the tests of the plan with results to find, by Results::key
+  static void index(const Plan& p, std::unordered_map<std::string, const Test*>& tests) {
+    const auto& suite = *p.suite;
+    for (auto i : p.tests) {
+      if (!suite.tests[i].is_stub)
+        tests[Results::key(suite.path, suite.tests[i].name)] = &suite.tests[i];
+    }
+    for (const auto& s : p.suites)
+      index(s, tests);
+  }
+
+  // the outcomes and durations of every test of the plan that ran
+  static void record(const Plan& p, Results& results) {
+    const auto& suite = *p.suite;
+    bool ran = false;
+    for (auto i : p.tests) {
+      const auto& test = suite.tests[i];
+      if (!test.is_stub && !test.cancelled) {
+        results.record(suite.path, test.name, test.failed, test.result().microseconds);
+        ran = true;
+      }
+    }
+    for (const auto& s : p.suites) {
+      record(s, results);
+      ran = ran || s.suite->successes + s.suite->failures > 0;
+    }
+    if (ran)
+      results.record(suite.path, suite.microseconds);
+  }
+};
+
+}
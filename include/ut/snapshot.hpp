@@ -0,0 +1,287 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <ut/assertions.hpp>
+#include <ut/buffers.hpp>
+#include <ut/files.hpp>
+#include <ut/mapping.hpp>
+#include <ut/test.hpp>
+
+namespace ut {
+
+// golden files a test's output is compared against, one per snapshot:
+//   <directory>/<suite path>/<test name>[.n].snap
+// goldens are mapped rather than read, and a .snap.hash next to one records
+// its size, modification time and hash, so matching output is recognized
+// without touching the golden at all; --update-snapshots rewrites the
+// goldens that differ, each replaced whole or not at all
+struct Snapshots {
+  struct Settings {
+    std::string directory = "snapshots";
+    bool update = false;
+  };
+
+  static Settings& settings() {
+    static Settings value;
+    return value;
+  }
+
+  enum class Verdict {
+    Match,
+    Missing,
+    Differs,
+    Updated
+  };
+
+  // where and how the output departs from the golden
+  struct Comparison {
+    Verdict verdict = Verdict::Match;
+    std::string file;
+    std::size_t offset = 0;
+    std::size_t golden = 0;
+    std::size_t size = 0;
+    std::string expected;
+    std::string error;
+  };
+
+  // the next snapshot of the test running on this thread
+  static std::string next() {
+    auto running = Running::current();
+    if (!running || !running->path || running->path->empty())
+      return std::string();
+    auto n = running->snapshots++;
+    return *running->path + "/" + file_name(*running->name) + (n > 0 ? "." + std::to_string(n) : std::string()) + ".snap";
+  }
+
+  static std::string file_name(const std::string& name) {
+    std::string s = name;
+    for (auto& c : s) {
+      bool plain = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-' || c == '.';
+      if (!plain)
+        c = '_';
+    }
+    return s;
+  }
+
+  // not cryptographic, just fast: four independent lanes keep the
+  // multiplier busy, so a buffer hashes at about memory bandwidth
+  static std::uint64_t hash(const unsigned char* p, std::size_t size) {
+    const std::uint64_t k = 0x9e3779b97f4a7c15ull;
+    std::uint64_t h0 = k, h1 = k * 3, h2 = k * 5, h3 = k * 7;
+    std::size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+      h0 = mix(h0, p + i, k);
+      h1 = mix(h1, p + i + 8, k);
+      h2 = mix(h2, p + i + 16, k);
+      h3 = mix(h3, p + i + 24, k);
+    }
+    std::uint64_t r = size;
+    for (auto h : {h0, h1, h2, h3})
+      r = (r ^ h ^ (h >> 29)) * k;
+    for (; i < size; ++i)
+      r = (r ^ p[i]) * k;
+    return r ^ (r >> 31);
+  }
+
+  static std::uint64_t mix(std::uint64_t h, const unsigned char* p, std::uint64_t k) {
+    std::uint64_t w;
+    std::memcpy(&w, p, sizeof(w));
+    h ^= w;
+    return ((h << 31) | (h >> 33)) * k;
+  }
+
+  // size and modification time, which a recorded hash is only good for
+  struct Stamp {
+    std::uint64_t size = 0;
+    std::int64_t modified = 0;
+
+    bool operator == (const Stamp& other) const {
+      return size == other.size && modified == other.modified;
+    }
+  };
+
+  static bool stamp(const std::string& file, Stamp& s) {
+    struct stat st;
+    if (stat(file.c_str(), &st) != 0)
+      return false;
+    s.size = st.st_size;
+    s.modified = static_cast<std::int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    return true;
+  }
+
+  // the hash recorded for the golden as it is now, if any
+  static bool recorded(const std::string& file, const Stamp& golden, std::uint64_t& h) {
+    std::ifstream in(file + ".hash");
+    Stamp s;
+    if (!(in >> s.size >> s.modified >> std::hex >> h))
+      return false;
+    return s == golden;
+  }
+
+  static Comparison compare(const std::string& file, const unsigned char* data, std::size_t size) {
+    Comparison c;
+    c.file = file;
+    c.size = size;
+
+    Stamp golden;
+    if (!stamp(file, golden)) {
+      c.verdict = Verdict::Missing;
+      return settings().update ? update(c, data, size) : c;
+    }
+
+    std::uint64_t h = 0;
+    bool hashed = false;
+    if (golden.size == size && recorded(file, golden, h)) {
+      if (hash(data, size) == h)
+        return c;
+      hashed = true;
+    }
+
+    Mapping mapping;
+    if (!mapping.open(file)) {
+      c.verdict = Verdict::Differs;
+      c.error = std::strerror(errno);
+      return c;
+    }
+    c.golden = mapping.size;
+    auto common = std::min(size, mapping.size);
+    c.offset = Buffers::mismatch(mapping.data, data, common);
+    if (c.offset == common && mapping.size == size) {
+      // no hash, or a stale one: record it the next time goldens are updated
+      if (settings().update && !hashed)
+        save_hash(file, data, size);
+      return c;
+    }
+
+    c.verdict = Verdict::Differs;
+    if (settings().update)
+      return update(c, data, size);
+    auto from = (c.offset > 16) ? c.offset - 16 : 0;
+    c.expected.assign(reinterpret_cast<const char*>(mapping.data) + from, std::min<std::size_t>(mapping.size - from, 64));
+    return c;
+  }
+
+  static Comparison& update(Comparison& c, const unsigned char* data, std::size_t size) {
+    if (!write(c.file, data, size) || !save_hash(c.file, data, size)) {
+      c.error = std::strerror(errno);
+      return c;
+    }
+    c.verdict = Verdict::Updated;
+    return c;
+  }
+
+  static bool write(const std::string& file, const void* data, std::size_t size) {
+    return directories(file) && Files::write(file, data, size);
+  }
+
+  static bool save_hash(const std::string& file, const unsigned char* data, std::size_t size) {
+    Stamp s;
+    if (!stamp(file, s))
+      return false;
+    std::stringstream out;
+    out << s.size << ' ' << s.modified << ' ' << std::hex << hash(data, size) << '\n';
+    auto text = out.str();
+    return write(file + ".hash", text.data(), text.size());
+  }
+
+  // every directory leading to file
+  static bool directories(const std::string& file) {
+    for (auto pos = file.find('/', 1); pos != std::string::npos; pos = file.find('/', pos + 1)) {
+      if (mkdir(file.substr(0, pos).c_str(), 0755) != 0 && errno != EEXIST)
+        return false;
+    }
+    return true;
+  }
+
+  static std::string describe(const Comparison& c, const unsigned char* data) {
+    std::stringstream out;
+    if (c.verdict == Verdict::Missing) {
+      out << "no snapshot " << c.file;
+      if (!c.error.empty())
+        out << ": " << c.error;
+      else
+        out << ", run with --update-snapshots to record it";
+      return out.str();
+    }
+    out << "snapshot " << c.file;
+    if (!c.error.empty())
+      return out.str() + ": " + c.error;
+    out << " differs at offset " << c.offset << ", sizes " << c.golden << " vs " << c.size;
+    auto from = (c.offset > 16) ? c.offset - 16 : 0;
+    out << "\n- [" << from << "] " << excerpt(c.expected);
+    out << "\n+ [" << from << "] " << excerpt(std::string(reinterpret_cast<const char*>(data) + from, std::min<std::size_t>(c.size - std::min(from, c.size), 64)));
+    return out.str();
+  }
+
+  // quoted if it reads as text, in hex otherwise
+  static std::string excerpt(const std::string& bytes) {
+    bool text = std::all_of(bytes.begin(), bytes.end(), [](char c) {
+      return (c >= 0x20 && c < 0x7f) || c == '\n' || c == '\r' || c == '\t';
+    });
+    if (text)
+      return Diff::show(bytes);
+    std::stringstream out;
+    out << std::hex << std::setfill('0');
+    for (std::size_t i = 0; i < bytes.size() && i < 32; ++i)
+      out << (i ? " " : "") << std::setw(2) << static_cast<unsigned>(static_cast<unsigned char>(bytes[i]));
+    return out.str();
+  }
+};
+
+template <typename... Args>
+UT_COLD void snapshot_failed(const Snapshots::Comparison& c, const unsigned char* data, Args&&... args) {
+  fail(Snapshots::describe(c, data), std::forward<Args>(args)...);
+}
+
+template <typename... Args>
+UT_COLD void snapshot_unnamed(Args&&... args) {
+  fail(std::string("snapshots need a synchronous test to be named after, or a file"), std::forward<Args>(args)...);
+}
+
+// the bytes of value, a std::string or contiguous range such as std::vector
+// or View, equal those of the golden file, relative to the snapshot
+// directory
+template <typename R, typename... Args>
+inline void assert_snapshot_file(const std::string& file, const R& value, Args&&... args) {
+  auto p = Buffers::data(value);
+  typedef typename std::remove_const<typename std::remove_pointer<decltype(p)>::type>::type T;
+  static_assert(std::is_trivially_copyable<T>::value, "snapshots are compared as bytes");
+  auto data = reinterpret_cast<const unsigned char*>(p);
+  auto c = Snapshots::compare(Snapshots::settings().directory + "/" + file, data, Buffers::size(value) * sizeof(T));
+  if (UT_LIKELY(c.verdict == Snapshots::Verdict::Match || c.verdict == Snapshots::Verdict::Updated))
+    return;
+
+  snapshot_failed(c, data, std::forward<Args>(args)...);
+}
+
+// as above, with the golden named after the running test
+template <typename R, typename... Args>
+inline void assert_snapshot(const R& value, Args&&... args) {
+  auto file = Snapshots::next();
+  if (file.empty())
+    snapshot_unnamed(std::forward<Args>(args)...);
+  assert_snapshot_file(file, value, std::forward<Args>(args)...);
+}
+
+}
+
+#define ut_assert_snapshot(value, ...) \
+ut::assert_snapshot(value, ut::Site{__FILE__, __LINE__, __func__}, ##__VA_ARGS__)
+
+#define ut_assert_snapshot_file(file, value, ...) \
+ut::assert_snapshot_file(file, value, ut::Site{__FILE__, __LINE__, __func__}, ##__VA_ARGS__)
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <unistd.h>
+
+// backtrace
+#include <backward.hpp>
+
+namespace ut {
+
+// process-wide cache of symbolized frames, so repeated failures from the
+// same site are only resolved once; optionally resolves captured stacks
+// ahead of time on a background thread
+struct SymbolCache {
+  // intentionally leaked so stacks can still be printed during static destruction
+  static SymbolCache& instance() {
+    static SymbolCache* cache = new SymbolCache();
+    return *cache;
+  }
+
+  bool background = false;
+
+  std::vector<std::string> resolve(const std::vector<void*>& addresses) {
+    std::vector<void*> missing;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      for (auto addr : addresses) {
+        if (frames.find(addr) == frames.end())
+          missing.push_back(addr);
+      }
+    }
+
+    if (!missing.empty())
+      symbolize(missing);
+
+    std::vector<std::string> result;
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto addr : addresses)
+      result.push_back(frames[addr]);
+    return result;
+  }
+
+  void prefetch(const std::vector<void*>& addresses) {
+    std::lock_guard<std::mutex> lock(mutex);
+    // a forked worker inherits the queue but not the thread draining it
+    if (owner != getpid()) {
+      owner = getpid();
+      std::thread([this]() { drain(); }).detach();
+    }
+    queue.push_back(addresses);
+    wake.notify_one();
+  }
+
+private:
+  // stands in for a backward::StackTrace when resolving a batch of addresses
+  struct Batch {
+    std::vector<void*> addresses;
+
+    void* const* begin() const {
+      return addresses.data();
+    }
+
+    std::size_t size() const {
+      return addresses.size();
+    }
+  };
+
+  void symbolize(const std::vector<void*>& addresses) {
+    // backward's resolver is not thread safe
+    std::lock_guard<std::mutex> resolving(resolver_mutex);
+
+    Batch batch;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      for (auto addr : addresses) {
+        if (frames.find(addr) == frames.end())
+          batch.addresses.push_back(addr);
+      }
+    }
+    if (batch.addresses.empty())
+      return;
+
+    resolver.load_stacktrace(batch);
+    std::vector<std::string> rendered;
+    for (std::size_t i = 0; i < batch.addresses.size(); ++i)
+      rendered.push_back(render(resolver.resolve(backward::ResolvedTrace(backward::Trace(batch.addresses[i], i)))));
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (std::size_t i = 0; i < batch.addresses.size(); ++i)
+      frames[batch.addresses[i]] = std::move(rendered[i]);
+  }
+
+  static std::string render(const backward::ResolvedTrace& trace) {
+    std::stringstream str;
+    if (!trace.source.filename.empty())
+      str << "Source \"" << trace.source.filename << "\", line " << trace.source.line << ", in " << trace.source.function;
+    else
+      str << "Object \"" << trace.object_filename << "\", at " << trace.addr << ", in " << trace.object_function;
+    return str.str();
+  }
+
+  void drain() {
+    while (true) {
+      std::vector<void*> addresses;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock, [this]() { return !queue.empty(); });
+        addresses = std::move(queue.front());
+        queue.pop_front();
+      }
+      resolve(addresses);
+    }
+  }
+
+  std::mutex mutex;
+  std::unordered_map<void*, std::string> frames;
+  std::deque<std::vector<void*>> queue;
+  std::condition_variable wake;
+  pid_t owner = 0;
+
+  std::mutex resolver_mutex;
+  backward::TraceResolver resolver;
+};
+
+// return addresses captured where an exception was raised; symbolized only
+// when printed, unless the stack was already rendered, e.g. by a worker
+struct Stack {
+  std::vector<void*> addresses;
+  std::string text;
+
+  Stack() {}
+
+  Stack(const std::string& text_)
+    : text(text_) {}
+
+  Stack(const char* text_)
+    : text(text_) {}
+
+  static Stack capture(std::size_t depth = 32) {
+    backward::StackTrace st;
+    st.load_here(depth);
+
+    Stack s;
+    s.addresses.reserve(st.size());
+    for (std::size_t i = 0; i < st.size(); ++i)
+      s.addresses.push_back(st[i].addr);
+
+    auto& cache = SymbolCache::instance();
+    if (cache.background)
+      cache.prefetch(s.addresses);
+    return s;
+  }
+
+  bool empty() const {
+    return addresses.empty() && text.empty();
+  }
+
+  std::string str() const {
+    if (addresses.empty())
+      return text;
+
+    std::stringstream out;
+    auto frames = SymbolCache::instance().resolve(addresses);
+    for (std::size_t i = 0; i < frames.size(); ++i)
+      out << "#" << i << "    " << frames[i] << "\n";
+    return out.str();
+  }
+};
+
+inline std::ostream& operator << (std::ostream& out, const Stack& s) {
+  return out << s.str();
+}
+
+inline std::string stack() {
+  return Stack::capture().str();
+}
+
+}
@@ -1,5 +1,9 @@
 #pragma once
 
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <deque>
 #include <functional>
 #include <string>
 #include <vector>
@@ -7,11 +11,18 @@
 #include <future>
 #include <stdexcept>
 #include <unordered_map>
+#include <atomic>
+#include <exception>
+#include <numeric>
 
 #include <sstream>
 
 #include <ut/test.hpp>
+#include <ut/filter.hpp>
 #include <ut/reporter.hpp>
+#include <ut/thread_pool.hpp>
+#include <ut/isolation.hpp>
+#include <ut/reporters/recording_reporter.hpp>
 
 namespace ut {
 
@@ -23,7 +34,8 @@ struct Suite : std::enable_shared_from_this<Suite> {
   std::vector<Action> _after;
   std::vector<Action> _afterEach;
 
-  std::vector<Test> tests;
+  // a deque grows in blocks, so registering tests never relocates earlier ones
+  std::deque<Test> tests;
   std::vector<std::shared_ptr<Suite>> suites;
 
   std::shared_ptr<Suite> parent = nullptr;
@@ -33,10 +45,23 @@ struct Suite : std::enable_shared_from_this<Suite> {
   mutable std::size_t failures = 0;
   mutable std::size_t successes = 0;
   mutable std::size_t stubs = 0;
+  mutable std::size_t cancelled = 0;
+  // before and after hooks that failed, here and below, counted apart from
+  // the tests, see exception
+  mutable std::size_t hook_failures = 0;
   mutable std::size_t microseconds = 0;
+  mutable std::shared_ptr<Comparison> comparison = nullptr;
+  // heap traffic of the suite's own hooks, when tracked
+  mutable Allocations hooks;
+  // what a before or after hook threw, e.g. on timeout, which fails the suite
+  mutable std::shared_ptr<ut::Exception> exception = nullptr;
 
   Suite() {}
 
+  bool failed() const {
+    return failures > 0 || hook_failures > 0;
+  }
+
   Suite(const char* name_)
     : name(name_), path(name_) {}
 
@@ -46,11 +71,34 @@ struct Suite : std::enable_shared_from_this<Suite> {
 
   }
 
+  // top level initializers that have yet to run, see prepare()
+  mutable std::vector<suite_initializer> deferred;
+
   void initialize() {
     parent->suites.push_back(shared_from_this());
     initialize(initializer);
   }
 
+  void defer() {
+    parent->suites.push_back(shared_from_this());
+    deferred.push_back(initializer);
+  }
+
+  // runs the deferred initializers the first time the suite is selected, so
+  // suites a run filters out never pay for their fixtures; nested suites
+  // register while their parent's initializer runs and capture its locals by
+  // reference, so only top level suites are ever deferred
+  void prepare() const {
+    if (deferred.empty())
+      return;
+    auto pending = std::move(deferred);
+    deferred.clear();
+    // suites are only ever viewed as const during selection, never created const
+    auto self = const_cast<Suite*>(this);
+    for (const auto& initializer_ : pending)
+      self->initialize(initializer_);
+  }
+
   void initialize(const suite_initializer& initializer_) {
     ActionAccumulator before(_before);
     ActionAccumulator beforeEach(_beforeEach);
@@ -70,62 +118,523 @@ struct Suite : std::enable_shared_from_this<Suite> {
     execute(defaultReporter, filter);
   }
 
+  // returns what the hooks allocated, see Heap
+  template <typename Cont>
+  Allocations call(const Cont& c) const {
+    Allocations total;
+    for (const auto& e : c) {
+      Allocations a;
+      e.run(&a);
+      total += a;
+    }
+    return total;
+  }
+
+  // runs hooks in process, where what they throw fails the test or suite
+  // they ran for instead of ending the run; the failure names the hook
   template <typename Cont>
-  void call(const Cont& c) const {
-    for (const auto& e : c)
-      e.run();
+  std::shared_ptr<ut::Exception> guarded(const char* hook, const Cont& c, Allocations& allocations) const {
+    try {
+      allocations += call(c);
+      return nullptr;
+    }
+    catch(ut::Exception& e) {
+      auto failure = std::make_shared<ut::Exception>(std::string(hook) + " hook: " + e.what(), LocationInfo(e.location));
+      failure->stack = e.stack;
+      return failure;
+    }
+    catch(std::exception& e) {
+      auto failure = std::make_shared<ut::Exception>(std::string(hook) + " hook: " + e.what(), LocationInfo());
+      failure->stack = Stack();
+      return failure;
+    }
   }
 
   template <typename Reporter = Reporter>
   void execute(Reporter& reporter = Reporter(), const std::string& filter = "") const {
-    failures = 0;
-    successes = 0;
-    stubs = 0;
-    microseconds = 0;
+    Context context;
+    execute(reporter, plan(Filter(filter)), context);
+  }
+
+  // the part of the tree selected for execution: test indices and child
+  // plans in execution order, with unselected subtrees left out entirely
+  struct Plan {
+    const Suite* suite = nullptr;
+    std::vector<std::size_t> tests;
+    std::vector<Plan> suites;
+    std::size_t job = ProcessPool::npos;
+    // holds tests that failed in an earlier run, see Runner::prioritize()
+    bool failing = false;
+    // expected microseconds of the suite's own tests and of the whole
+    // subtree, see Runner::estimate()
+    double own = 0;
+    double total = 0;
+
+    // whether any selected test actually runs, and so needs the hooks
+    bool runnable() const {
+      for (auto i : tests) {
+        if (!suite->tests[i].is_stub)
+          return true;
+      }
+      return false;
+    }
+  };
+
+  Plan plan(const Filter& filter) const {
+    Plan p;
+    if (filter.empty())
+      select(p);
+    else
+      select(filter, filter.root(), p);
+    return p;
+  }
+
+  void select(Plan& p) const {
+    prepare();
+    p.suite = this;
+    for (std::size_t i = 0; i < tests.size(); ++i)
+      p.tests.push_back(i);
+    p.suites.resize(suites.size());
+    for (std::size_t i = 0; i < suites.size(); ++i)
+      suites[i]->select(p.suites[i]);
+  }
+
+  // only descends into children the filter can still match, and drops the
+  // ones where nothing was selected
+  bool select(const Filter& filter, const Filter::Cursor& cursor, Plan& p) const {
+    prepare();
+    if (filter.all(cursor)) {
+      select(p);
+      return true;
+    }
+
+    p.suite = this;
+    bool selected = false;
+    for (std::size_t i = 0; i < tests.size(); ++i) {
+      if (filter.selects(cursor, path, tests[i].name)) {
+        p.tests.push_back(i);
+        selected = true;
+      }
+    }
+
+    for (const auto& s : suites) {
+      auto next = filter.descend(cursor, s->name);
+      if (!next.alive())
+        continue;
+      p.suites.emplace_back();
+      if (s->select(filter, next, p.suites.back()))
+        selected = true;
+      else
+        p.suites.pop_back();
+    }
+    return selected;
+  }
+
+  // order for work that runs side by side: whatever holds tests that failed
+  // last time, then the longest first, so no long suite starts last
+  template <typename Key>
+  static std::vector<std::size_t> schedule(std::size_t n, const Key& key) {
+    std::vector<std::size_t> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) {
+      return key(a) > key(b);
+    });
+    return order;
+  }
+
+  // how the tree is being executed: in process, optionally on a thread pool,
+  // or in isolated worker processes
+  struct Context {
+    ThreadPool* pool = nullptr;
+    ProcessPool* processes = nullptr;
+    // results were read back from the shards of a run, see Merge
+    bool merged = false;
+    // failures so far across the whole tree, and how many stop the run, 0
+    // for no limit; worker processes apply the limit themselves
+    std::atomic<std::size_t>* failures = nullptr;
+    std::size_t max_failures = 0;
+
+    bool cancelled() const {
+      return max_failures > 0 && failures->load(std::memory_order_relaxed) >= max_failures;
+    }
+
+    void finished(const Test& test) const {
+      if (test.failed && failures)
+        failures->fetch_add(1, std::memory_order_relaxed);
+    }
+  };
+
+  // numbers the plans with tests to run as isolation jobs
+  static void collect(Plan& p, std::vector<const Plan*>& jobs, std::vector<std::vector<const Test*>>& tests) {
+    if (p.runnable()) {
+      p.job = jobs.size();
+      jobs.push_back(&p);
+      tests.emplace_back();
+      for (auto i : p.tests) {
+        if (!p.suite->tests[i].is_stub)
+          tests.back().push_back(&p.suite->tests[i]);
+      }
+    }
+    for (auto& s : p.suites)
+      collect(s, jobs, tests);
+  }
+
+  // runs inside a worker process, resuming the job at its test number first;
+  // hooks fail what they ran for just as in process, see guarded()
+  void run_isolated(const Plan& p, std::size_t first, ProcessPool::Channel& channel) const {
+    Allocations allocations;
+    auto hook = [&](const char* name, const std::vector<Action>& c) {
+      channel.hooking(name);
+      auto failure = guarded(name, c, allocations);
+      channel.hooking(nullptr);
+      return failure;
+    };
+
+    auto failure = hook("before", _before);
+
+    std::size_t n = 0;
+    for (auto i : p.tests) {
+      if (failure)
+        break;
+      const auto& test = tests[i];
+      if (test.is_stub)
+        continue;
+      auto current = n++;
+      if (current < first || channel.skipped(current))
+        continue;
+      if (channel.cancelled())
+        break;
+
+      channel.started(current);
+      auto before = hook("beforeEach", _beforeEach);
+      if (!before)
+        test.run(path);
+      test.fail(before ? before : hook("afterEach", _afterEach));
+      channel.finished(p.job, current, test);
+    }
+
+    auto after = hook("after", _after);
+    if (failure || after)
+      channel.hook(p.job, failure ? *failure : *after);
+  }
+
+  struct Tally {
+    std::size_t failures = 0;
+    std::size_t successes = 0;
+    std::size_t stubs = 0;
+    std::size_t cancelled = 0;
+    std::size_t hook_failures = 0;
+    std::size_t microseconds = 0;
+    // the suite's own hooks only
+    Allocations hooks;
+
+    void add(const Test& test) {
+      if (test.failed)
+        ++failures;
+      else
+        ++successes;
+      microseconds += test.result().microseconds;
+    }
+
+    void add(const Suite& s) {
+      failures += s.failures;
+      successes += s.successes;
+      stubs += s.stubs;
+      cancelled += s.cancelled;
+      hook_failures += s.hook_failures;
+      microseconds += s.microseconds;
+    }
+  };
+
+  // counters are tallied locally and published once the suite is complete,
+  // so a parent reading them after its children finish never races
+  template <typename Reporter>
+  void execute(Reporter& reporter, const Plan& p, const Context& context) const {
+    Tally tally;
+    exception = nullptr;
 
     reporter.suiteStarted(*this);
 
-    call(_before);
+    if (context.processes || context.merged) {
+      if (p.job != ProcessPool::npos)
+        exception = context.processes->wait(p.job);
+      report_tests(reporter, p, context, tally);
+    }
+    else if (p.runnable() && !context.cancelled()) {
+      // nothing runs on top of a failed before hook
+      exception = guarded("before", _before, tally.hooks);
+      if (exception)
+        report_tests(reporter, p, context, tally);
+      else
+        run_tests(reporter, p, context, tally);
+      auto failure = guarded("after", _after, tally.hooks);
+      if (!exception)
+        exception = failure;
+    }
+    else {
+      // nothing to run, or the run stopped before reaching the suite
+      report_tests(reporter, p, context, tally);
+    }
+
+    if (exception) {
+      ++tally.hook_failures;
+      if (context.failures)
+        context.failures->fetch_add(1, std::memory_order_relaxed);
+    }
+
+    if (context.pool)
+      run_suites(reporter, p, context, tally);
+    else {
+      for (const auto& s : p.suites) {
+        s.suite->execute(reporter, s, context);
+        tally.add(*s.suite);
+      }
+    }
+
+    failures = tally.failures;
+    successes = tally.successes;
+    stubs = tally.stubs;
+    cancelled = tally.cancelled;
+    hook_failures = tally.hook_failures;
+    microseconds = tally.microseconds;
+    hooks = tally.hooks;
+
+    if (failed())
+      reporter.suiteFailed(*this);
+    else
+      reporter.suiteSucceeded(*this);
+  }
+
+  template <typename Reporter>
+  void report(Reporter& reporter, const Test& test, Tally& tally) const {
+    if (test.failed)
+      reporter.testFailed(test);
+    else
+      reporter.testSucceeded(test);
+    tally.add(test);
+  }
 
-    for (const auto& test : tests) {
+  template <typename Reporter>
+  void cancel(Reporter& reporter, const Test& test, Tally& tally) const {
+    test.cancelled = true;
+    reporter.testCancelled(test);
+    ++tally.cancelled;
+  }
+
+  // reports tests that are not going to run here: recorded by an isolated
+  // worker or merged from shards, either of which may have cancelled them,
+  // stubs, or cancelled
+  template <typename Reporter>
+  void report_tests(Reporter& reporter, const Plan& p, const Context& context, Tally& tally) const {
+    for (auto i : p.tests) {
+      const auto& test = tests[i];
       if (test.is_stub) {
         reporter.testStubbed(test);
-        ++stubs;
+        ++tally.stubs;
         continue;
       }
 
-      call(_beforeEach);
+      if (!(context.processes || context.merged) || test.cancelled) {
+        cancel(reporter, test, tally);
+        continue;
+      }
 
       reporter.testStarted(test);
-      test.run();
-      if (test.failed) {
-        reporter.testFailed(test);
-        ++failures;
+      report(reporter, test, tally);
+    }
+  }
+
+  template <typename Reporter>
+  void run_tests(Reporter& reporter, const Plan& p, const Context& context, Tally& tally) const {
+    for (std::size_t k = 0; k < p.tests.size(); ++k) {
+      const auto& test = tests[p.tests[k]];
+      if (test.is_stub) {
+        reporter.testStubbed(test);
+        ++tally.stubs;
+        continue;
       }
-      else {
-        reporter.testSucceeded(test);
-        ++successes;
+
+      if (context.cancelled()) {
+        cancel(reporter, test, tally);
+        continue;
+      }
+
+      if (test.independent && test.async) {
+        k = run_overlapped(reporter, p, k, context, tally) - 1;
+        continue;
+      }
+
+      if (context.pool && test.independent) {
+        k = run_independent(reporter, p, k, context, tally) - 1;
+        continue;
+      }
+
+      auto failure = guarded("beforeEach", _beforeEach, tally.hooks);
+
+      reporter.testStarted(test);
+      if (!failure)
+        test.run(path);
+      test.fail(failure ? failure : guarded("afterEach", _afterEach, tally.hooks));
+      context.finished(test);
+      report(reporter, test, tally);
+    }
+  }
+
+  // end of the block of adjacent planned tests from first that may run together
+  std::size_t block(const Plan& p, std::size_t first, bool async) const {
+    auto last = first;
+    while (last < p.tests.size()) {
+      const auto& test = tests[p.tests[last]];
+      if (!test.independent || test.async != async || test.is_stub)
+        break;
+      ++last;
+    }
+    return last;
+  }
+
+  // runs the block of adjacent independent tests starting at first on the
+  // pool, then reports them in declaration order; returns the end of the block
+  template <typename Reporter>
+  std::size_t run_independent(Reporter& reporter, const Plan& p, std::size_t first, const Context& context, Tally& tally) const {
+    auto last = block(p, first, false);
+
+    // hooks of tests running side by side are tallied here, in order
+    std::vector<Allocations> hooks(last - first);
+    Join join(*context.pool, last - first);
+    for (auto k = first; k < last; ++k) {
+      const auto& test = tests[p.tests[k]];
+      auto& allocations = hooks[k - first];
+      join.submit(k - first, [this, &test, &context, &allocations]() {
+        // tests still queued when the run stops are never started
+        test.cancelled = context.cancelled();
+        if (test.cancelled)
+          return;
+        auto failure = guarded("beforeEach", _beforeEach, allocations);
+        if (!failure)
+          test.run(path);
+        test.fail(failure ? failure : guarded("afterEach", _afterEach, allocations));
+        context.finished(test);
+      });
+    }
+
+    for (auto k = first; k < last; ++k) {
+      join.wait(k - first);
+      tally.hooks += hooks[k - first];
+      const auto& test = tests[p.tests[k]];
+      if (test.cancelled) {
+        cancel(reporter, test, tally);
+        continue;
       }
-      microseconds += test.microseconds;
+      reporter.testStarted(test);
+      report(reporter, test, tally);
+    }
+    return last;
+  }
+
+  // starts the block of adjacent independent async tests from first on the
+  // shared executor, then collects and reports them in declaration order;
+  // each body returns before the next beforeEach runs, so only what they
+  // wait for overlaps
+  template <typename Reporter>
+  std::size_t run_overlapped(Reporter& reporter, const Plan& p, std::size_t first, const Context& context, Tally& tally) const {
+    auto last = block(p, first, true);
 
-      call(_afterEach);
+    std::vector<Action::Pending> pending(last - first);
+    std::vector<std::shared_ptr<ut::Exception>> failures(last - first);
+    for (auto k = first; k < last; ++k) {
+      const auto& test = tests[p.tests[k]];
+      // tests yet to start when the run stops never are
+      test.cancelled = context.cancelled();
+      if (test.cancelled)
+        continue;
+      failures[k - first] = guarded("beforeEach", _beforeEach, tally.hooks);
+      if (failures[k - first])
+        continue;
+      pending[k - first] = test.start();
+      test.returned(pending[k - first]);
     }
 
-    call(_after);
+    for (auto k = first; k < last; ++k) {
+      const auto& test = tests[p.tests[k]];
+      if (test.cancelled) {
+        cancel(reporter, test, tally);
+        continue;
+      }
+      auto& failure = failures[k - first];
+      if (!failure)
+        test.finish(pending[k - first]);
+      test.fail(failure ? failure : guarded("afterEach", _afterEach, tally.hooks));
+      context.finished(test);
+      reporter.testStarted(test);
+      report(reporter, test, tally);
+    }
+    return last;
+  }
 
-    for (const auto& s : suites) {
-      s->execute(reporter, filter);
-      successes += s->successes;
-      failures += s->failures;
-      stubs += s->stubs;
-      microseconds += s->microseconds;
+  // sibling suites execute concurrently into their own event logs, which are
+  // replayed in tree order as soon as every earlier sibling has completed;
+  // they are started longest first
+  template <typename Reporter>
+  void run_suites(Reporter& reporter, const Plan& p, const Context& context, Tally& tally) const {
+    std::vector<RecordingReporter> logs(p.suites.size());
+    Join join(*context.pool, p.suites.size());
+    auto order = schedule(p.suites.size(), [&p](std::size_t i) {
+      return std::make_pair(p.suites[i].failing, p.suites[i].total);
+    });
+    // a worker takes what it submitted newest first
+    if (context.pool->lifo())
+      std::reverse(order.begin(), order.end());
+    for (auto i : order) {
+      join.submit(i, [i, &p, &logs, &context]() {
+        p.suites[i].suite->execute(logs[i], p.suites[i], context);
+      });
     }
 
-    if (failures > 0)
-      reporter.suiteFailed(*this);
-    else
-      reporter.suiteSucceeded(*this);
+    for (std::size_t i = 0; i < p.suites.size(); ++i) {
+      join.wait(i);
+      logs[i].replay(reporter);
+      tally.add(*p.suites[i].suite);
+    }
   }
+
+  // tracks completion of a fixed set of pool tasks and rethrows their
+  // exceptions on the waiting thread
+  struct Join {
+    Join(ThreadPool& pool_, std::size_t size)
+      : pool(pool_), done(new std::atomic<bool>[size]), errors(size)
+    {
+      for (std::size_t i = 0; i < size; ++i)
+        done[i] = false;
+    }
+
+    ~Join() {
+      // never leave tasks referring to this frame behind
+      for (std::size_t i = 0; i < errors.size(); ++i)
+        pool.wait_until([&]() { return done[i].load(); });
+    }
+
+    void submit(std::size_t i, const std::function<void()>& fn) {
+      pool.submit([this, i, fn]() {
+        try {
+          fn();
+        }
+        catch(...) {
+          errors[i] = std::current_exception();
+        }
+        done[i] = true;
+      });
+    }
+
+    void wait(std::size_t i) {
+      pool.wait_until([&]() { return done[i].load(); });
+      if (errors[i])
+        std::rethrow_exception(errors[i]);
+    }
+
+    ThreadPool& pool;
+    std::unique_ptr<std::atomic<bool>[]> done;
+    std::vector<std::exception_ptr> errors;
+  };
 };
 
 }
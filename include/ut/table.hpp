@@ -0,0 +1,503 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <ut/assertions.hpp>
+#include <ut/expect.hpp>
+#include <ut/mapping.hpp>
+#include <ut/parallel.hpp>
+
+namespace ut {
+
+// a file of test cases, one per row: lines of CSV, or fixed size binary
+// records; rows are numbered from 1, a CSV header not included
+struct Table {
+  std::string file;
+  // bytes per binary record, 0 for CSV
+  std::size_t record = 0;
+  char separator = ',';
+  // the first CSV line names the columns
+  bool header = true;
+
+  static Table csv(const std::string& file, char separator = ',', bool header = true) {
+    Table t;
+    t.file = file;
+    t.separator = separator;
+    t.header = header;
+    return t;
+  }
+
+  static Table records(const std::string& file, std::size_t size) {
+    Table t;
+    t.file = file;
+    t.record = size;
+    t.header = false;
+    return t;
+  }
+};
+
+// one CSV field, pointing into the mapped table; surrounding quotes are
+// dropped, doubled quotes inside are only undone by str()
+struct Field {
+  const char* data = nullptr;
+  std::size_t size = 0;
+  bool quoted = false;
+
+  std::string str() const {
+    std::string s(data, size);
+    if (quoted) {
+      for (auto pos = s.find("\"\""); pos != std::string::npos; pos = s.find("\"\"", pos + 1))
+        s.erase(pos, 1);
+    }
+    return s;
+  }
+
+  long long integer() const {
+    char buffer[64];
+    return std::strtoll(terminated(buffer), nullptr, 10);
+  }
+
+  double number() const {
+    char buffer[64];
+    return std::strtod(terminated(buffer), nullptr);
+  }
+
+  bool empty() const {
+    return size == 0;
+  }
+
+  friend bool operator == (const Field& f, const std::string& s) {
+    return f.quoted ? f.str() == s : (f.size == s.size() && std::equal(f.data, f.data + f.size, s.data()));
+  }
+
+  friend bool operator == (const std::string& s, const Field& f) {
+    return f == s;
+  }
+
+  friend bool operator != (const Field& f, const std::string& s) {
+    return !(f == s);
+  }
+
+  friend bool operator != (const std::string& s, const Field& f) {
+    return !(f == s);
+  }
+
+  friend std::ostream& operator << (std::ostream& out, const Field& f) {
+    return out << f.str();
+  }
+
+private:
+  // numbers are short, so they are parsed from a copy on the stack
+  const char* terminated(char (&buffer)[64]) const {
+    auto n = std::min(size, sizeof(buffer) - 1);
+    std::memcpy(buffer, data, n);
+    buffer[n] = '\0';
+    return buffer;
+  }
+};
+
+struct Row {
+  std::size_t number = 0;
+  // the line without its line break, or the record
+  const char* data = nullptr;
+  std::size_t size = 0;
+
+  // CSV fields, split on first use; binary records have none
+  std::size_t fields() const {
+    split();
+    return cells->size();
+  }
+
+  const Field& operator [] (std::size_t i) const {
+    split();
+    if (i >= cells->size())
+      throw std::out_of_range("row " + std::to_string(number) + " has " + std::to_string(cells->size()) + " fields, not " + std::to_string(i + 1));
+    return (*cells)[i];
+  }
+
+  const Field& operator [] (const std::string& column) const {
+    if (header) {
+      auto found = std::find(header->begin(), header->end(), column);
+      if (found != header->end())
+        return (*this)[found - header->begin()];
+    }
+    throw std::out_of_range("no column " + column);
+  }
+
+  // a value of a binary record, at a byte offset
+  template <typename T>
+  T as(std::size_t offset = 0) const {
+    static_assert(std::is_trivially_copyable<T>::value, "records are read as bytes");
+    if (offset + sizeof(T) > size)
+      throw std::out_of_range("record " + std::to_string(number) + " has " + std::to_string(size) + " bytes, reading " + std::to_string(offset + sizeof(T)));
+    T value;
+    std::memcpy(&value, data + offset, sizeof(T));
+    return value;
+  }
+
+  // points the row at another line, split again on use
+  void reset(const char* data_, std::size_t size_) {
+    data = data_;
+    size = size_;
+    split_ = false;
+  }
+
+  char separator = ',';
+  const std::vector<std::string>* header = nullptr;
+  // scratch space of the batch, reused from row to row
+  std::vector<Field>* cells = nullptr;
+
+private:
+  mutable bool split_ = false;
+
+  void split() const {
+    if (!cells)
+      throw std::logic_error("binary records have no fields");
+    if (split_)
+      return;
+    split_ = true;
+    cells->clear();
+    auto p = data, end = data + size;
+    while (true) {
+      Field f;
+      if (p < end && *p == '"') {
+        // quoted, up to a quote that is not doubled
+        f.quoted = true;
+        auto q = ++p;
+        while (q < end && !(*q == '"' && (q + 1 == end || q[1] != '"')))
+          q += (*q == '"') ? 2 : 1;
+        f.data = p;
+        f.size = std::min(q, end) - p;
+        p = std::min(q + 1, end);
+        while (p < end && *p != separator)
+          ++p;
+      }
+      else {
+        auto q = static_cast<const char*>(std::memchr(p, separator, end - p));
+        if (!q)
+          q = end;
+        f.data = p;
+        f.size = q - p;
+        p = q;
+      }
+      cells->push_back(f);
+      if (p >= end)
+        break;
+      ++p;
+    }
+  }
+};
+
+// what the rows of a table test came to; only the first failing rows are
+// kept, see Tables::Settings
+struct Rows {
+  struct Failure {
+    std::size_t row = 0;
+    std::string message;
+    std::string file;
+    std::size_t line = 0;
+    std::string func;
+
+    LocationInfo location() const {
+      return LocationInfo(file, line, func);
+    }
+  };
+
+  std::size_t total = 0;
+  // selected by --rows
+  std::size_t ran = 0;
+  std::size_t passed = 0;
+  std::size_t failed = 0;
+  std::vector<Failure> failures;
+
+  // keeps the lowest numbered limit failures
+  void trim(std::size_t limit) {
+    std::sort(failures.begin(), failures.end(), [](const Failure& a, const Failure& b) {
+      return a.row < b.row;
+    });
+    if (failures.size() > limit)
+      failures.resize(limit);
+  }
+};
+
+// runs a test body over the rows of a Table: the file is mapped, not read,
+// and cut into batches that run on jobs threads, each row failing on its
+// own without stopping the rest; expectations fail the row they are in
+struct Tables {
+  typedef std::pair<std::size_t, std::size_t> Range;
+
+  struct Settings {
+    std::size_t jobs = 1;
+    // inclusive ranges of row numbers to run, sorted, none for all
+    std::vector<Range> rows;
+    // failing rows kept per table, the rest are only counted
+    std::size_t failures = 20;
+  };
+
+  static Settings& settings() {
+    static Settings value;
+    return value;
+  }
+
+  // e.g. 7,100-200
+  static std::vector<Range> parse(const std::string& spec) {
+    std::vector<Range> ranges;
+    std::size_t pos = 0;
+    while (pos < spec.size()) {
+      auto end = spec.find(',', pos);
+      if (end == std::string::npos)
+        end = spec.size();
+      auto part = spec.substr(pos, end - pos);
+      char* dash = nullptr;
+      auto first = std::strtoull(part.c_str(), &dash, 10);
+      std::size_t last = first;
+      // an open range runs to the last row
+      if (*dash == '-' && dash[1] == '\0') {
+        last = static_cast<std::size_t>(-1);
+        ++dash;
+      }
+      else if (*dash == '-')
+        last = std::strtoull(dash + 1, &dash, 10);
+      if (part.empty() || *dash != '\0' || first < 1 || last < first)
+        throw std::invalid_argument("--rows expects row numbers and ranges like 7,100-200,500-, got " + spec);
+      ranges.emplace_back(first, last);
+      pos = end + 1;
+    }
+    // overlapping ranges would run rows twice
+    std::sort(ranges.begin(), ranges.end());
+    std::vector<Range> merged;
+    for (const auto& r : ranges) {
+      if (!merged.empty() && r.first - 1 <= merged.back().second)
+        merged.back().second = std::max(merged.back().second, r.second);
+      else
+        merged.push_back(r);
+    }
+    return merged;
+  }
+
+  static bool selected(std::size_t number) {
+    const auto& rows = settings().rows;
+    if (rows.empty())
+      return true;
+    auto after = std::upper_bound(rows.begin(), rows.end(), Range(number, static_cast<std::size_t>(-1)));
+    for (auto r = rows.begin(); r != after; ++r)
+      if (number <= r->second)
+        return true;
+    return false;
+  }
+
+  // whether any row in [first, last] is selected
+  static bool selected(std::size_t first, std::size_t last) {
+    const auto& rows = settings().rows;
+    if (rows.empty())
+      return true;
+    for (const auto& r : rows)
+      if (r.first <= last && first <= r.second)
+        return true;
+    return false;
+  }
+
+  // a batch's running totals, merged into the table's when done
+  struct Batch {
+    Rows rows;
+    Expectations expectations;
+    std::vector<Field> cells;
+  };
+
+  template <typename Body>
+  static void row(Batch& batch, Row& r, const Body& body) {
+    ++batch.rows.ran;
+    Rows::Failure failure;
+    try {
+      body(static_cast<const Row&>(r));
+      if (UT_LIKELY(batch.expectations.empty())) {
+        ++batch.rows.passed;
+        return;
+      }
+      const auto& first = batch.expectations.failures.front().location;
+      failure.file = first.file;
+      failure.line = first.line;
+      failure.func = first.func;
+    }
+    catch(ut::Exception& e) {
+      failure.message = e.what();
+      failure.file = e.location.file;
+      failure.line = e.location.line;
+      failure.func = e.location.func;
+    }
+    catch(std::exception& e) {
+      failure.message = e.what();
+    }
+    catch(...) {
+      failure.message = "unknown exception";
+    }
+
+    failure.row = r.number;
+    if (!batch.expectations.empty()) {
+      auto text = batch.expectations.str();
+      failure.message = failure.message.empty() ? text : text + "\n  " + failure.message;
+      batch.expectations.failures.clear();
+    }
+    ++batch.rows.failed;
+    batch.rows.failures.push_back(std::move(failure));
+    if (batch.rows.failures.size() >= 2 * settings().failures)
+      batch.rows.trim(settings().failures);
+  }
+
+  template <typename Body>
+  static void run(const Table& table, const Body& body, Rows& rows) {
+    rows = Rows();
+    Mapping mapping;
+    if (!mapping.open(table.file))
+      throw std::runtime_error("unable to map table " + table.file + ": " + std::strerror(errno));
+
+    std::mutex mutex;
+    auto jobs = std::max<std::size_t>(settings().jobs, 1);
+    auto merge = [&](Batch& batch) {
+      std::lock_guard<std::mutex> lock(mutex);
+      rows.ran += batch.rows.ran;
+      rows.passed += batch.rows.passed;
+      rows.failed += batch.rows.failed;
+      for (auto& f : batch.rows.failures)
+        rows.failures.push_back(std::move(f));
+    };
+
+    if (table.record > 0)
+      records(table, mapping, body, rows, jobs, merge);
+    else
+      lines(table, mapping, body, rows, jobs, merge);
+    rows.trim(settings().failures);
+  }
+
+  // records are addressed directly, so unselected ones are never touched
+  template <typename Body, typename Merge>
+  static void records(const Table& table, const Mapping& mapping, const Body& body, Rows& rows, std::size_t jobs, const Merge& merge) {
+    if (mapping.size % table.record != 0)
+      throw std::runtime_error("table " + table.file + " is not a whole number of " + std::to_string(table.record) + " byte records");
+    rows.total = mapping.size / table.record;
+
+    const std::size_t batch_rows = 65536;
+    std::vector<Range> batches;
+    auto selection = settings().rows.empty() ? std::vector<Range>{Range(1, rows.total)} : settings().rows;
+    for (auto s : selection) {
+      s.second = std::min(s.second, rows.total);
+      for (auto first = s.first; first <= s.second; first += batch_rows)
+        batches.emplace_back(first, std::min(s.second, first + batch_rows - 1));
+    }
+
+    Parallel::each(batches.size(), jobs, [&](std::size_t b) {
+      Batch batch;
+      Expectations::Scope collecting(&batch.expectations);
+      Row r;
+      r.size = table.record;
+      for (auto n = batches[b].first; n <= batches[b].second; ++n) {
+        r.number = n;
+        r.data = reinterpret_cast<const char*>(mapping.data) + (n - 1) * table.record;
+        row(batch, r, body);
+      }
+      merge(batch);
+    });
+  }
+
+  // lines are cut into byte ranges at line breaks; with more than one, the
+  // breaks in each are counted first, which numbers the rows of the next
+  template <typename Body, typename Merge>
+  static void lines(const Table& table, const Mapping& mapping, const Body& body, Rows& rows, std::size_t jobs, const Merge& merge) {
+    auto begin = reinterpret_cast<const char*>(mapping.data);
+    auto end = begin + mapping.size;
+
+    std::vector<std::string> header;
+    if (table.header && begin < end) {
+      auto line = next(begin, end);
+      Batch batch;
+      Row r;
+      r.separator = table.separator;
+      r.data = begin;
+      r.size = trimmed(begin, line);
+      r.cells = &batch.cells;
+      for (std::size_t i = 0; i < r.fields(); ++i)
+        header.push_back(r[i].str());
+      begin = std::min(line + 1, end);
+    }
+
+    // a few batches per thread evens out uneven rows
+    std::size_t n = (jobs > 1) ? jobs * 8 : 1;
+    std::vector<const char*> cuts{begin};
+    for (std::size_t i = 1; i < n; ++i) {
+      auto target = begin + (end - begin) * i / n;
+      cuts.push_back((target <= cuts.back()) ? cuts.back() : std::min(next(target - 1, end) + 1, end));
+    }
+    cuts.push_back(end);
+
+    std::vector<std::size_t> first(n + 1, 1);
+    if (n > 1) {
+      std::vector<std::size_t> counts(n);
+      Parallel::each(n, jobs, [&](std::size_t b) {
+        counts[b] = std::count(cuts[b], cuts[b + 1], '\n');
+      });
+      for (std::size_t b = 0; b < n; ++b)
+        first[b + 1] = first[b] + counts[b];
+    }
+    else {
+      first[1] = 1 + std::count(begin, end, '\n');
+    }
+    // a last line without a line break is a row too
+    rows.total = first[n] - 1 + ((begin < end && end[-1] != '\n') ? 1 : 0);
+
+    Parallel::each(n, jobs, [&](std::size_t b) {
+      if (!selected(first[b], first[b + 1]))
+        return;
+      Batch batch;
+      Expectations::Scope collecting(&batch.expectations);
+      Row r;
+      r.separator = table.separator;
+      r.header = &header;
+      r.cells = &batch.cells;
+      r.number = first[b];
+      for (auto p = cuts[b]; p < cuts[b + 1]; ++r.number) {
+        auto line = next(p, cuts[b + 1]);
+        if (selected(r.number)) {
+          r.reset(p, trimmed(p, line));
+          row(batch, r, body);
+        }
+        p = line + 1;
+      }
+      merge(batch);
+    });
+  }
+
+  static const char* next(const char* p, const char* end) {
+    auto line = static_cast<const char*>(std::memchr(p, '\n', end - p));
+    return line ? line : end;
+  }
+
+  // length of the line from p to its break, less a carriage return
+  static std::size_t trimmed(const char* p, const char* line) {
+    return (line > p && line[-1] == '\r') ? line - p - 1 : line - p;
+  }
+
+  // fails a table test for its rows, at the first failing row
+  static void fail(const Rows& rows) {
+    std::stringstream out;
+    out << rows.failed << " of " << rows.ran << " rows failed";
+    if (rows.failures.empty())
+      throw ut::Exception(out.str(), LocationInfo());
+    const auto& f = rows.failures.front();
+    out << ", first row " << f.row << ": " << f.message;
+    throw ut::Exception(out.str(), f.location());
+  }
+};
+
+}
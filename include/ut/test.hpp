@@ -3,13 +3,26 @@
 #include <functional>
 #include <string>
 #include <vector>
+#include <deque>
 #include <memory>
 #include <future>
 #include <stdexcept>
 #include <unordered_map>
+#include <atomic>
+#include <exception>
 
 #include <ut/timer.hpp>
+#include <ut/names.hpp>
+#include <ut/capture.hpp>
+#include <ut/executor.hpp>
+#include <ut/benchmark.hpp>
+#include <ut/regression.hpp>
 #include <ut/assertions.hpp>
+#include <ut/watchdog.hpp>
+#include <ut/heap.hpp>
+#include <ut/expect.hpp>
+#include <ut/table.hpp>
+#include <ut/property.hpp>
 
 #include <sstream>
 
@@ -18,36 +31,115 @@ namespace ut {
 typedef std::function<void()> void_callback;
 typedef std::function<void(const void_callback&)> registration;
 
+// state shared by an async action and the callback handed to its body,
+// settled by whichever of the callback or an escaping exception comes first
+struct completion {
+  std::promise<std::string> promise;
+  // the body itself returned, whether or not it called back yet
+  std::promise<void> returned;
+  std::atomic<bool> settled{false};
+  timer clock;
+
+  void set(const std::string& msg) {
+    if (settled.exchange(true))
+      return;
+    clock.stop();
+    promise.set_value(msg);
+  }
+
+  void fail(std::exception_ptr error) {
+    if (settled.exchange(true))
+      return;
+    clock.stop();
+    promise.set_exception(error);
+  }
+};
+
 struct callback {
-  callback(std::promise<std::string>& p)
-    : _p(p) {}
+  callback(const std::shared_ptr<completion>& state)
+    : _state(state) {}
 
   template <typename T>
   void operator()(const T& obj) const {
     std::stringstream str;
     str << obj;
-    _p.set_value(str.str());
+    _state->set(str.str());
   }
 
   void operator()(const std::string& msg) const {
-    _p.set_value(msg);
+    _state->set(msg);
   }
   void operator()() const {
-    _p.set_value("");
+    _state->set("");
   }
 
-  std::promise<std::string>& _p;
+  std::shared_ptr<completion> _state;
 };
 
 typedef std::function<void(const callback&)> async_callback;
 typedef std::function<std::string()> parent_name_getter;
 
+// the test a synchronous body on this thread belongs to, for what is named
+// after it, see Snapshots
+struct Running {
+  const std::string* path = nullptr;
+  const std::string* name = nullptr;
+  // snapshots taken so far, which numbers the next
+  std::size_t snapshots = 0;
+
+  static Running*& current() {
+    static thread_local Running* value = nullptr;
+    return value;
+  }
+
+  struct Scope {
+    Scope(Running* running)
+      : previous(current())
+    {
+      current() = running;
+    }
+
+    ~Scope() {
+      current() = previous;
+    }
+
+    Running* previous;
+  };
+};
+
 struct Action {
   const void_callback cb = nullptr;
   const async_callback async_cb = nullptr;
   const bool async = false;
+  // 0 falls back to Watchdog::default_limit()
+  std::chrono::milliseconds time_limit{0};
+
+  // e.g. it("name", cb).timeout(std::chrono::seconds(2))
+  Action& timeout(std::chrono::milliseconds limit) {
+    time_limit = limit;
+    return *this;
+  }
+
+  std::chrono::milliseconds limit() const {
+    return (time_limit.count() > 0) ? time_limit : Watchdog::default_limit();
+  }
 
-  void run() const {
+  // what a synchronous body left behind on whichever thread ran it
+  struct Outcome {
+    Allocations allocations;
+    Expectations expectations;
+    Usage usage;
+    std::shared_ptr<Statistics> statistics;
+    Running running;
+    std::atomic<bool> ready{false};
+  };
+
+  // optionally records what a synchronous body allocated, see Heap, and
+  // the resources of the thread it ran on, see Usage, and collects its
+  // failed expectations instead of letting them throw; given statistics,
+  // the body is measured repeatedly instead, see Benchmark
+  void run(Allocations* allocations = nullptr, Expectations* expectations = nullptr, Usage* usage = nullptr,
+           std::shared_ptr<Statistics>* statistics = nullptr) const {
     if (!cb && !async_cb) {
       // stubbed
       return;
@@ -56,31 +148,164 @@ struct Action {
     if (async)
       run_async();
     else
-      run_sync();
+      run_sync(allocations, expectations, usage, statistics);
   }
 
-  void run_sync() const {
-    cb();
+  void run_sync(Allocations* allocations = nullptr, Expectations* expectations = nullptr, Usage* usage = nullptr,
+                std::shared_ptr<Statistics>* statistics = nullptr) const {
+    bool measure = allocations && Heap::installed();
+    if (!measure && !expectations && !usage && !statistics) {
+      Watchdog::run(cb, limit());
+      return;
+    }
+    if (limit().count() <= 0 || !Watchdog::in_process()) {
+      run_here(allocations, expectations, usage, statistics);
+      return;
+    }
+
+    // the body runs on a helper thread when limited; one abandoned on
+    // timeout never publishes, and is left the outcome to itself
+    auto outcome = std::make_shared<Outcome>();
+    if (Running::current())
+      outcome->running = *Running::current();
+    auto body = cb;
+    bool collect = expectations != nullptr;
+    bool sample = usage != nullptr;
+    bool repeat = statistics != nullptr;
+    struct Publish {
+      Outcome& outcome;
+      Heap::Scope& measuring;
+      const rusage* before;
+
+      ~Publish() {
+        outcome.allocations = measuring.stop();
+        if (before)
+          outcome.usage = Usage::between(*before, Usage::sample(true));
+        outcome.ready.store(true, std::memory_order_release);
+      }
+    };
+    struct Collect {
+      Outcome& outcome;
+      Allocations* allocations;
+      Expectations* expectations;
+      Usage* usage;
+      std::shared_ptr<Statistics>* statistics;
+
+      ~Collect() {
+        if (!outcome.ready.load(std::memory_order_acquire))
+          return;
+        if (allocations)
+          *allocations = outcome.allocations;
+        if (expectations)
+          expectations->failures = std::move(outcome.expectations.failures);
+        if (usage)
+          *usage = outcome.usage;
+        if (statistics)
+          *statistics = outcome.statistics;
+      }
+    } collected{*outcome, measure ? allocations : nullptr, expectations, usage, statistics};
+
+    Watchdog::run([body, outcome, collect, sample, repeat]() {
+      Expectations::Scope collecting(collect ? &outcome->expectations : nullptr);
+      Running::Scope naming(&outcome->running);
+      rusage before = rusage();
+      if (sample)
+        before = Usage::sample(true);
+      Heap::Scope measuring;
+      Publish publish{*outcome, measuring, sample ? &before : nullptr};
+      if (repeat)
+        outcome->statistics = std::make_shared<Statistics>(Benchmark::run(body));
+      else
+        body();
+    }, limit());
   }
 
-  void run_async() const {
-    auto promise = std::promise<std::string>();
-    std::thread thr([&]() {
-      async_cb(callback(promise));
+  // the body stays on the calling thread, so its scopes go straight on it
+  void run_here(Allocations* allocations, Expectations* expectations, Usage* usage,
+                std::shared_ptr<Statistics>* statistics) const {
+    struct Stop {
+      Heap::Scope& measuring;
+      Allocations* allocations;
+      const rusage& before;
+      Usage* usage;
+
+      ~Stop() {
+        auto measured = measuring.stop();
+        if (allocations && Heap::installed())
+          *allocations = measured;
+        if (usage)
+          *usage = Usage::between(before, Usage::sample(true));
+      }
+    };
+    Expectations::Scope collecting(expectations);
+    rusage before = rusage();
+    if (usage)
+      before = Usage::sample(true);
+    Heap::Scope measuring;
+    Stop stop{measuring, allocations, before, usage};
+    if (statistics)
+      Watchdog::run([this, statistics]() { *statistics = std::make_shared<Statistics>(Benchmark::run(cb)); }, limit());
+    else
+      Watchdog::run(cb, limit());
+  }
+
+  // an async action in flight on the shared executor
+  struct Pending {
+    std::shared_ptr<completion> state;
+    std::future<std::string> future;
+    std::future<void> returned;
+    std::chrono::steady_clock::time_point started;
+    rusage resources;
+  };
+
+  Pending start_async() const {
+    Pending pending;
+    pending.state = std::make_shared<completion>();
+    pending.future = pending.state->promise.get_future();
+    pending.returned = pending.state->returned.get_future();
+
+    auto state = pending.state;
+    auto body = async_cb;
+    pending.started = std::chrono::steady_clock::now();
+    state->clock.start();
+    Executor::instance().submit([state, body]() {
+      try {
+        body(callback(state));
+      }
+      catch(...) {
+        state->fail(std::current_exception());
+      }
+      state->returned.set_value();
     });
-    auto future = promise.get_future();
-    auto ret = future.get();
-    thr.join();
+    return pending;
+  }
+
+  // waits for the body of a started action to return, and hand its work to
+  // the callback, for no longer than the time limit
+  void returned(Pending& pending) const {
+    if (limit().count() <= 0)
+      pending.returned.wait();
+    else
+      pending.returned.wait_until(pending.started + limit());
+  }
+
+  void finish_async(Pending& pending) const {
+    auto ret = Watchdog::wait(pending.future, limit(), pending.started);
     ut_assert(ret.empty(), ret);
   }
 
+  void run_async() const {
+    auto pending = start_async();
+    finish_async(pending);
+  }
+
   Action() {}
 
-  Action(const void_callback& cb_)
-    : cb(cb_) {}
+  Action(void_callback cb_)
+    : cb(std::move(cb_)) {}
 
-  Action(const async_callback& async_cb_)
-    : async_cb(async_cb_), async(true) {}
+  Action(async_callback async_cb_)
+    : async_cb(std::move(async_cb_)), async(true) {}
 };
 
 struct ActionAccumulator {
@@ -88,65 +313,232 @@ struct ActionAccumulator {
     : _actions(actions) {}
 
   template <typename Cb>
-  void operator()(const Cb& cb) {
+  Action& operator()(const Cb& cb) {
     _actions.emplace_back(cb);
+    return _actions.back();
   }
 
   std::vector<Action>& _actions;
 };
 
+// what running a test produced; only tests that ran, or were reported on,
+// carry one, so a large registered tree stays small, see Test::result()
+struct Result {
+  std::shared_ptr<ut::Exception> exception = nullptr;
+  std::string message;
+  double seconds = 0;
+  std::size_t microseconds = 0;
+  std::shared_ptr<Statistics> statistics = nullptr;
+  Usage usage;
+  // heap traffic of a synchronous body, when tracked
+  Allocations allocations;
+  // checks that failed without stopping the body, see ut_expect
+  Expectations expectations;
+  // what the test wrote to stdout and stderr, see Capture
+  std::string out;
+  std::string err;
+  // against a baseline run, see BaselineReporter
+  std::shared_ptr<Comparison> comparison = nullptr;
+};
+
 struct Test : public Action {
-  const std::string name;
+  // interned, see Names
+  const std::string& name;
   bool is_stub = false;
-  mutable std::shared_ptr<ut::Exception> exception = nullptr;
-  mutable std::string message;
+  // may run concurrently with neighbouring independent tests of its suite
+  bool independent = false;
+  // measured repeatedly, see Benchmark
+  bool benchmark = false;
   mutable bool failed = false;
-  mutable double seconds = 0;
-  mutable std::size_t microseconds = 0;
+  // skipped because the run stopped early
+  mutable bool cancelled = false;
+  // per row outcomes of a table test, see Tables
+  std::shared_ptr<Rows> rows = nullptr;
+  // cases a property test ran, and how fast, see Properties
+  std::shared_ptr<Cases> cases = nullptr;
 
-  void run() const {
+  // allocated on first use by whichever thread runs or reports the test
+  Result& result() const {
+    if (!result_)
+      result_.reset(new Result());
+    return *result_;
+  }
+
+  // path is that of the suite, for Running
+  void run(const std::string& path = std::string()) const {
+    Running running;
+    running.path = &path;
+    running.name = &name;
+    Running::Scope naming(&running);
+
+    bool capture = Capture::enabled();
+    if (capture)
+      Capture::instance().begin();
+
+    // a synchronous body is sampled on whichever thread runs it, see
+    // Action::run; async bodies run on the executor, so only the process
+    // wide figures cover them
+    bool measure = Usage::enabled();
+    rusage before;
+    if (measure && async)
+      before = Usage::sample(false);
+
+    auto& r = result();
     timer t;
     t.start();
+    record([this, measure, &r]() {
+      if (benchmark)
+        Action::run(nullptr, nullptr, measure ? &r.usage : nullptr, &r.statistics);
+      else
+        Action::run(&r.allocations, &r.expectations, measure ? &r.usage : nullptr);
+    });
+    if (!r.expectations.empty())
+      fail_unmet();
+    t.stop();
+    r.seconds = t.seconds();
+    r.microseconds = t.count();
+    if (measure && async)
+      r.usage = Usage::between(before, Usage::sample(false));
+
+    if (capture)
+      Capture::instance().end(r.out, r.err);
+  }
+
+  // starts an async test; finish() waits for its callback, so a suite can
+  // keep several independent async tests in flight at once
+  Pending start() const {
+    rusage before;
+    if (Usage::enabled())
+      before = Usage::sample(false);
+    auto pending = start_async();
+    pending.resources = before;
+    return pending;
+  }
+
+  // overlapping tests share the process wide usage figures of their lifetimes
+  void finish(Pending& pending) const {
+    record([&]() {
+      finish_async(pending);
+    });
+    auto& r = result();
+    r.seconds = pending.state->clock.seconds();
+    r.microseconds = pending.state->clock.count();
+    if (Usage::enabled())
+      r.usage = Usage::between(pending.resources, Usage::sample(false));
+  }
+
+  // fails the test with what a hook around it threw, unless it failed by itself
+  void fail(const std::shared_ptr<ut::Exception>& failure) const {
+    if (!failure || failed)
+      return;
+    failed = true;
+    result().exception = failure;
+  }
+
+  // failed expectations fail the test, listed ahead of whatever else
+  // stopped it, which keeps its location and stack
+  void fail_unmet() const {
+    failed = true;
+    auto& r = result();
+    auto text = r.expectations.str();
+    if (r.exception) {
+      auto e = std::make_shared<ut::Exception>(text + "\n  " + r.exception->what(), LocationInfo(r.exception->location));
+      e->stack = r.exception->stack;
+      r.exception = e;
+      return;
+    }
+    if (!r.message.empty())
+      text += "\n  " + r.message;
+    r.exception = std::make_shared<ut::Exception>(std::move(text), LocationInfo(r.expectations.failures.front().location));
+    // each expectation has its own location, and none a stack
+    r.exception->stack = Stack();
+  }
+
+  template <typename Fn>
+  void record(const Fn& fn) const {
     try {
-      Action::run();
+      fn();
     }
     catch(ut::Exception& e) {
       failed = true;
-      exception = std::make_shared<ut::Exception>(std::move(e));
+      result().exception = std::make_shared<ut::Exception>(std::move(e));
     }
     catch(std::exception& e) {
       failed = true;
-      message = e.what();
+      result().message = e.what();
     }
-    t.stop();
-    seconds = t.seconds();
-    microseconds = t.count();
   }
 
   Test(const std::string& name_)
-    : Action(), name(name_), is_stub(true) {}
+    : Action(), name(Names::intern(name_)), is_stub(true) {}
+
+  Test(const std::string& name_, void_callback cb_)
+    : Action(std::move(cb_)), name(Names::intern(name_)) {}
 
-  Test(const std::string& name_, const void_callback& cb_)
-    : Action(cb_), name(name_) {}
+  Test(const std::string& name_, async_callback async_cb_)
+    : Action(std::move(async_cb_)), name(Names::intern(name_)) {}
 
-  Test(const std::string& name_, const async_callback& async_cb_)
-    : Action(async_cb_), name(name_) {}
+private:
+  mutable std::unique_ptr<Result> result_;
 };
 
 struct TestAccumulator {
-  TestAccumulator(std::vector<Test>& tests)
+  TestAccumulator(std::deque<Test>& tests)
     : _tests(tests) {}
 
-  void operator()(const std::string& name) {
+  Test& operator()(const std::string& name) {
     _tests.emplace_back(name);
+    return _tests.back();
+  }
+
+  template <typename Cb>
+  Test& operator()(const std::string& name, const Cb& cb) {
+    _tests.emplace_back(name, cb);
+    return _tests.back();
+  }
+
+  template <typename Cb>
+  Test& independent(const std::string& name, const Cb& cb) {
+    _tests.emplace_back(name, cb);
+    _tests.back().independent = true;
+    return _tests.back();
   }
 
+  // one test over every row of a table, reported as a whole: the body is
+  // called with each ut::Row, and the test fails with the rows that did
   template <typename Cb>
-  void operator()(const std::string& name, const Cb& cb) {
+  Test& table(const std::string& name, const Table& table, const Cb& body) {
+    auto rows = std::make_shared<Rows>();
+    _tests.emplace_back(name, void_callback([table, body, rows]() {
+      Tables::run(table, body, *rows);
+      if (rows->failed > 0)
+        Tables::fail(*rows);
+    }));
+    _tests.back().rows = rows;
+    return _tests.back();
+  }
+
+  // one test over many cases of gen, reported as a whole: the body asserts,
+  // or returns whether it holds, and the test fails with the smallest case
+  // found to falsify it
+  template <typename G, typename Cb>
+  Test& property(const std::string& name, const G& gen, const Cb& body) {
+    auto cases = std::make_shared<Cases>();
+    _tests.emplace_back(name, void_callback([gen, body, cases]() {
+      Properties::run(gen, body, *cases);
+    }));
+    _tests.back().cases = cases;
+    return _tests.back();
+  }
+
+  // measured repeatedly, reporting timing statistics, see Benchmark
+  Test& bench(const std::string& name, const void_callback& cb) {
     _tests.emplace_back(name, cb);
+    _tests.back().benchmark = true;
+    return _tests.back();
   }
 
-  std::vector<Test>& _tests;
+  std::deque<Test>& _tests;
 };
 
 }
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ut {
+
+typedef std::function<void()> task;
+
+// work-stealing pool: each worker pops from the back of its own deque,
+// idle workers steal from the front of the others, tasks submitted from
+// outside the pool go to a shared injection queue
+struct ThreadPool {
+  struct Queue {
+    std::mutex mutex;
+    std::deque<task> tasks;
+  };
+
+  ThreadPool(std::size_t threads)
+    : queues(threads)
+  {
+    for (auto& q : queues)
+      q = std::make_shared<Queue>();
+    for (std::size_t i = 0; i < threads; ++i)
+      workers.emplace_back([this, i]() { work(i); });
+  }
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    wake.notify_all();
+    for (auto& w : workers)
+      w.join();
+  }
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator = (const ThreadPool&) = delete;
+
+  std::size_t size() const {
+    return workers.size();
+  }
+
+  void submit(task t) {
+    auto index = current_index();
+    auto& queue = (index < queues.size()) ? *queues[index] : injected;
+    {
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      queue.tasks.push_back(std::move(t));
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      ++pending;
+    }
+    wake.notify_one();
+  }
+
+  // whether the calling thread takes the tasks it submits newest first, as
+  // workers do; everyone takes tasks submitted from outside oldest first
+  bool lifo() {
+    return current_index() < queues.size();
+  }
+
+  // runs a single queued task on the calling thread, if one is available
+  bool run_one() {
+    task t;
+    if (!take(t))
+      return false;
+    t();
+    finished();
+    return true;
+  }
+
+  // helps with queued work until the predicate holds, so that tasks may
+  // wait on tasks they submitted without starving the pool
+  template <typename Predicate>
+  void wait_until(const Predicate& done) {
+    while (!done()) {
+      if (run_one())
+        continue;
+      std::unique_lock<std::mutex> lock(mutex);
+      progress.wait_for(lock, std::chrono::milliseconds(1), [&]() { return pending > 0 || done(); });
+    }
+  }
+
+private:
+  // worker index of the calling thread, or npos when called from outside
+  std::size_t& current_index_impl() {
+    static thread_local std::size_t index = npos;
+    return index;
+  }
+
+  ThreadPool*& current_pool() {
+    static thread_local ThreadPool* pool = nullptr;
+    return pool;
+  }
+
+  std::size_t current_index() {
+    if (current_pool() != this)
+      return npos;
+    return current_index_impl();
+  }
+
+  bool pop_back(Queue& queue, task& t) {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty())
+      return false;
+    t = std::move(queue.tasks.back());
+    queue.tasks.pop_back();
+    return true;
+  }
+
+  bool pop_front(Queue& queue, task& t) {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty())
+      return false;
+    t = std::move(queue.tasks.front());
+    queue.tasks.pop_front();
+    return true;
+  }
+
+  bool take(task& t) {
+    auto index = current_index();
+    bool found = (index < queues.size() && pop_back(*queues[index], t)) || pop_front(injected, t);
+    for (std::size_t i = 1; !found && i <= queues.size(); ++i)
+      found = pop_front(*queues[(index + i) % queues.size()], t);
+    if (found) {
+      std::lock_guard<std::mutex> lock(mutex);
+      --pending;
+    }
+    return found;
+  }
+
+  void finished() {
+    progress.notify_all();
+  }
+
+  void work(std::size_t index) {
+    current_pool() = this;
+    current_index_impl() = index;
+    while (true) {
+      if (run_one())
+        continue;
+      std::unique_lock<std::mutex> lock(mutex);
+      wake.wait(lock, [&]() { return pending > 0 || stopping; });
+      if (stopping && pending == 0)
+        return;
+    }
+  }
+
+  static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+  std::vector<std::shared_ptr<Queue>> queues;
+  Queue injected;
+  std::vector<std::thread> workers;
+
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::condition_variable progress;
+  std::size_t pending = 0;
+  bool stopping = false;
+};
+
+}
@@ -1,18 +1,85 @@
 #pragma once
 
 #include <chrono>
+#include <cstdint>
+#include <thread>
+
+#include <sys/resource.h>
+#include <sys/time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#define UT_HAS_TSC 1
+#endif
 
 namespace ut {
 
+// the time stamp counter as an optional, cheaper clock; only used once
+// calibrated against the monotonic clock and when the cpu reports an
+// invariant counter, so frequency scaling and sleep states don't skew it
+struct tsc {
+  static bool& enabled() {
+    static bool value = false;
+    return value;
+  }
+
+  static double& ns_per_tick() {
+    static double value = 1;
+    return value;
+  }
+
+  static bool available() {
+#ifdef UT_HAS_TSC
+    unsigned eax, ebx, ecx, edx;
+    if (!__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) || eax < 0x80000007)
+      return false;
+    __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+    return (edx & (1 << 8)) != 0;
+#else
+    return false;
+#endif
+  }
+
+  static std::uint64_t read() {
+#ifdef UT_HAS_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+  }
+
+  // returns false, leaving the monotonic clock in use, without an invariant tsc
+  static bool enable() {
+    if (!available())
+      return false;
+
+    typedef std::chrono::steady_clock clock;
+    auto start = clock::now();
+    auto ticks = read();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    auto elapsed = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+    ns_per_tick() = elapsed / (read() - ticks);
+    enabled() = true;
+    return true;
+  }
+};
+
+// measures with the monotonic clock, which unlike the system clock never
+// jumps when the wall time is adjusted
 struct timer {
   typedef std::chrono::seconds s;
   typedef std::chrono::microseconds us;
+  typedef std::chrono::steady_clock clock;
 
   timer()
-    : start_time(now()) { }
+    : start_time(now()), stop_time(start_time) { }
 
-  std::chrono::time_point<std::chrono::system_clock> now() {
-    return std::chrono::system_clock::now();
+  // nanoseconds, or tsc ticks once enabled
+  static std::uint64_t now() {
+    if (tsc::enabled())
+      return tsc::read();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now().time_since_epoch()).count();
   }
 
   void start() {
@@ -23,16 +90,68 @@ struct timer {
     stop_time = now();
   }
 
+  std::uint64_t nanoseconds() {
+    if (stop_time < start_time)
+      return 0;
+    auto elapsed = stop_time - start_time;
+    return tsc::enabled() ? static_cast<std::uint64_t>(elapsed * tsc::ns_per_tick()) : elapsed;
+  }
+
   std::size_t count() {
-    return std::chrono::duration_cast<us>(stop_time - start_time).count();
+    return nanoseconds() / 1000;
   }
 
   double seconds() {
-    return count() / 1000000.0;
+    return nanoseconds() / 1000000000.0;
   }
 
-  std::chrono::time_point<std::chrono::system_clock> start_time;
-  std::chrono::time_point<std::chrono::system_clock> stop_time;
+  std::uint64_t start_time;
+  std::uint64_t stop_time;
+};
+
+// resources consumed while a test ran, from getrusage; covers the calling
+// thread where the platform supports it, the whole process otherwise
+struct Usage {
+  std::size_t user_microseconds = 0;
+  std::size_t system_microseconds = 0;
+  std::size_t voluntary_switches = 0;
+  std::size_t involuntary_switches = 0;
+  std::size_t minor_faults = 0;
+  std::size_t major_faults = 0;
+  // growth of the process' peak resident set, in kilobytes
+  std::size_t max_rss_delta = 0;
+
+  static bool& enabled() {
+    static bool value = true;
+    return value;
+  }
+
+  static rusage sample(bool thread) {
+    rusage r;
+#ifdef RUSAGE_THREAD
+    getrusage(thread ? RUSAGE_THREAD : RUSAGE_SELF, &r);
+#else
+    (void) thread;
+    getrusage(RUSAGE_SELF, &r);
+#endif
+    return r;
+  }
+
+  static std::size_t microseconds(const timeval& t) {
+    return t.tv_sec * 1000000 + t.tv_usec;
+  }
+
+  static Usage between(const rusage& before, const rusage& after) {
+    Usage u;
+    u.user_microseconds = microseconds(after.ru_utime) - microseconds(before.ru_utime);
+    u.system_microseconds = microseconds(after.ru_stime) - microseconds(before.ru_stime);
+    u.voluntary_switches = after.ru_nvcsw - before.ru_nvcsw;
+    u.involuntary_switches = after.ru_nivcsw - before.ru_nivcsw;
+    u.minor_faults = after.ru_minflt - before.ru_minflt;
+    u.major_faults = after.ru_majflt - before.ru_majflt;
+    u.max_rss_delta = (after.ru_maxrss > before.ru_maxrss) ? after.ru_maxrss - before.ru_maxrss : 0;
+    return u;
+  }
 };
 
 }
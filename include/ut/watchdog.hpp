@@ -0,0 +1,214 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <execinfo.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+#include <ut/assertions.hpp>
+#include <ut/thread_pool.hpp>
+
+namespace ut {
+
+// enforces time limits on test bodies and hooks
+//
+// in process, a limited body runs on a helper thread owned by the calling
+// thread; if it overruns, the helper's stack is sampled, the helper is
+// abandoned to its fate and the caller moves on with a timeout failure.
+// inside isolated workers nothing is abandoned: an interval timer raises
+// SIGALRM, which ends the worker with the stack of the stuck test
+struct Watchdog {
+  typedef std::chrono::milliseconds duration;
+
+  // applies to every test and hook without a limit of its own, 0 for none
+  static duration& default_limit() {
+    static duration value(0);
+    return value;
+  }
+
+  // false inside isolated workers, which are ended instead
+  static bool& in_process() {
+    static bool value = true;
+    return value;
+  }
+
+  // the limit the running alarm enforces, for the worker's crash report
+  static duration& armed() {
+    static duration value(0);
+    return value;
+  }
+
+  static std::string message(duration limit) {
+    return "timed out after " + std::to_string(limit.count()) + "ms";
+  }
+
+  static void run(const std::function<void()>& fn, duration limit) {
+    if (limit.count() <= 0)
+      fn();
+    else if (in_process())
+      run_abandonable(fn, limit);
+    else
+      run_alarmed(fn, limit);
+  }
+
+  // waits on an async action started at start, which only an alarm can cut
+  // short in a worker
+  template <typename T>
+  static T wait(std::future<T>& future, duration limit, std::chrono::steady_clock::time_point start) {
+    if (limit.count() <= 0)
+      return future.get();
+    if (in_process()) {
+      if (future.wait_until(start + limit) == std::future_status::timeout) {
+        // nothing runs on behalf of a callback that was never invoked
+        ut::Exception e(message(limit));
+        e.stack = Stack();
+        throw e;
+      }
+      return future.get();
+    }
+    auto remaining = std::chrono::duration_cast<duration>(start + limit - std::chrono::steady_clock::now());
+    Alarm alarm(limit, std::max(remaining, duration(1)));
+    return future.get();
+  }
+
+private:
+  struct Alarm {
+    Alarm(duration limit, duration remaining) {
+      armed() = limit;
+      set(remaining);
+    }
+
+    ~Alarm() {
+      set(duration(0));
+      armed() = duration(0);
+    }
+
+    static void set(duration limit) {
+      itimerval timer;
+      std::memset(&timer, 0, sizeof(timer));
+      timer.it_value.tv_sec = limit.count() / 1000;
+      timer.it_value.tv_usec = (limit.count() % 1000) * 1000;
+      setitimer(ITIMER_REAL, &timer, nullptr);
+    }
+  };
+
+  static void run_alarmed(const std::function<void()>& fn, duration limit) {
+    Alarm alarm(limit, limit);
+    fn();
+  }
+
+  struct Outcome {
+    std::promise<void> promise;
+    std::atomic<bool> started{false};
+    pthread_t thread;
+  };
+
+  // frames of an overrunning helper, written from its signal handler
+  struct Sample {
+    void* frames[64];
+    std::atomic<int> size{-1};
+  };
+
+  static Sample& sample() {
+    static Sample s;
+    return s;
+  }
+
+  static void sample_handler(int) {
+    auto& s = sample();
+    s.size = backtrace(s.frames, 64);
+  }
+
+  // the helper of the calling thread; released rather than destroyed once
+  // stuck, since destroying it would join the stuck thread
+  static std::unique_ptr<ThreadPool>& helper() {
+    static thread_local std::unique_ptr<ThreadPool> pool;
+    return pool;
+  }
+
+  static void run_abandonable(const std::function<void()>& fn, duration limit) {
+    auto& pool = helper();
+    if (!pool)
+      pool.reset(new ThreadPool(1));
+
+    auto outcome = std::make_shared<Outcome>();
+    auto future = outcome->promise.get_future();
+    // copied, so an abandoned body never refers to the caller's frame
+    auto body = fn;
+    pool->submit([outcome, body]() {
+      outcome->thread = pthread_self();
+      outcome->started = true;
+      try {
+        body();
+        outcome->promise.set_value();
+      }
+      catch(...) {
+        outcome->promise.set_exception(std::current_exception());
+      }
+    });
+
+    if (future.wait_for(limit) == std::future_status::ready)
+      return future.get();
+
+    ut::Exception e(message(limit));
+    e.stack = outcome->started ? stuck(outcome->thread) : Stack();
+    pool.release();
+    throw e;
+  }
+
+  // the sampling handler, in place only while a stuck thread is sampled so
+  // whatever the program installed for SIGURG gets it back
+  struct Sampling {
+    Sampling() {
+      // the first backtrace loads the unwinder, which must not happen in a handler
+      void* warmup[1];
+      backtrace(warmup, 1);
+      struct sigaction action;
+      std::memset(&action, 0, sizeof(action));
+      action.sa_handler = sample_handler;
+      action.sa_flags = SA_RESTART;
+      sigemptyset(&action.sa_mask);
+      sigaction(SIGURG, &action, &previous);
+    }
+
+    ~Sampling() {
+      sigaction(SIGURG, &previous, nullptr);
+    }
+
+    struct sigaction previous;
+  };
+
+  // interrupts the stuck thread to record where it is
+  static Stack stuck(pthread_t thread) {
+    static std::mutex mutex;
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto& s = sample();
+    s.size = -1;
+    Stack stack;
+    Sampling sampling;
+    if (pthread_kill(thread, SIGURG) != 0)
+      return stack;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
+    while (s.size < 0 && std::chrono::steady_clock::now() < deadline)
+      std::this_thread::yield();
+    // skips the handler and the signal trampoline
+    if (s.size > 2)
+      stack.addresses.assign(s.frames + 2, s.frames + s.size);
+    return stack;
+  }
+};
+
+}
@@ -8,6 +8,9 @@
 
 using namespace ut;
 
+// count every test's heap allocations
+ut_track_allocations()
+
 namespace {
 
 suite(example1)
@@ -87,6 +90,13 @@ done(example1)
 }
 
 int main(int argc, char* argv[]) {
-  OstreamReporter rep(std::cout);
-  Registry::get("root")->execute(rep);
+  Options options(argc, argv);
+  Runner::apply(options);
+  FileStream console(STDOUT_FILENO);
+  OstreamReporter rep(console);
+  AsyncReporter async(rep, console);
+  BaselineReporter baseline(async, options);
+  auto root = Registry::get("root");
+  Runner::execute(*root, baseline, options);
+  return (root->failed() || baseline.failed()) ? 1 : 0;
 }
@@ -1,15 +1,54 @@
 #include <uber_test.hpp>
 
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
 #include <iostream>
 #include <sstream>
 #include <stdexcept>
 #include <thread>
 #include <chrono>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
 
 using namespace ut;
 
 namespace {
 
+// whether buffers of n copies of a and b compare near; 64 values go
+// through the registers, 1 straight to Buffers::near
+template <typename T>
+bool near_in(std::size_t n, T a, T b, const ut::Tolerance& tolerance) {
+  std::vector<T> x(n, a), y(n, b);
+  try {
+    ut_assert_near(x, y, tolerance);
+    return true;
+  }
+  catch(ut::Exception&) {
+    return false;
+  }
+}
+
+template <typename T>
+void check_non_finite() {
+  const T inf = std::numeric_limits<T>::infinity(), nan = std::numeric_limits<T>::quiet_NaN();
+  auto tolerance = ut::within(0, 0.01);
+  for (std::size_t n : {1, 64}) {
+    ut_assert(!near_in<T>(n, 1, inf, tolerance), "1 near inf in", n);
+    ut_assert(!near_in<T>(n, inf, 1, tolerance), "inf near 1 in", n);
+    ut_assert(!near_in<T>(n, -inf, inf, tolerance), "-inf near inf in", n);
+    ut_assert(!near_in<T>(n, 1, nan, tolerance), "1 near NaN in", n);
+    ut_assert(!near_in<T>(n, nan, 1, tolerance), "NaN near 1 in", n);
+    ut_assert(near_in<T>(n, inf, inf, tolerance), "inf apart from inf in", n);
+    ut_assert(near_in<T>(n, nan, nan, tolerance), "NaN apart from NaN in", n);
+  }
+}
+
 suite(example2)
   auto val = std::make_shared<std::string>();
 
@@ -49,6 +88,113 @@ suite(example2)
     ut_assert_eq(*val, "3");
   });
 
+  // measured repeatedly, reporting timing statistics
+  it.bench("should sum a small vector", [] {
+    std::vector<int> values(64, 1);
+    int sum = 0;
+    for (auto v : values)
+      sum += v;
+    do_not_optimize(sum);
+  });
+
+  // counted once ut_track_allocations() is in place, see example.cpp
+  it("should stay within an allocation budget", [] {
+    std::vector<int> values;
+    ut_assert_max_allocations(1, values.reserve(64));
+  });
+
+  // a passing assertion costs about as much as its comparison
+  it.bench("should pass an assertion", [] {
+    int value = 1;
+    do_not_optimize(value);
+    ut_assert_eq(value, 1, "never formatted");
+  });
+
+  // the test goes on past each, and reports them all once it ends
+  it("should report every unmet expectation", [] {
+    std::vector<int> values = {1, 2, 3};
+    for (std::size_t i = 0; i < values.size(); ++i)
+      ut_expect_eq(values[i], 2, "at", i);
+  });
+
+  it("should show where large values differ", [] {
+    std::vector<int> expected(1000000);
+    for (std::size_t i = 0; i < expected.size(); ++i)
+      expected[i] = i;
+    auto actual = expected;
+    actual.insert(actual.begin() + 500000, -1);
+    ut_assert_eq(expected, actual);
+  });
+
+  it("should compare buffers in bulk", [] {
+    std::vector<float> expected(1 << 20), actual(1 << 20);
+    for (std::size_t i = 0; i < expected.size(); ++i) {
+      expected[i] = std::sin(i * 0.001f);
+      actual[i] = std::nextafter(expected[i], 2.0f);
+    }
+    ut_assert_near(expected, actual, ut::within(0, 0, 1));
+    ut_assert_bytes_eq(expected.data(), expected.data(), expected.size() * sizeof(float));
+    ut_assert_buffer_eq(expected, actual);
+  });
+
+  // a non-finite value is near only its equal, whatever the tolerance
+  it("should keep infinities and NaNs apart from finite values", [] {
+    check_non_finite<float>();
+    check_non_finite<double>();
+  });
+
+  it("should match its snapshot", [] {
+    std::string report;
+    for (int i = 0; i < 1000; ++i)
+      report += "row " + std::to_string(i) + "\n";
+    ut_assert_snapshot(report);
+  });
+
+  // every row of the table checked by one test, numbered from 1; the table
+  // is written to a directory of the run's own, removed once the suite is done
+  std::string tables = std::string(P_tmpdir) + "/ut-tables-" + std::to_string(getpid());
+  before([tables] {
+    if (mkdir(tables.c_str(), 0700) != 0)
+      throw std::runtime_error("unable to create " + tables);
+    std::ofstream out(tables + "/squares.csv");
+    out << "value,square\n";
+    for (int i = 0; i < 10000; ++i)
+      out << i << ',' << (i == 4321 ? 0 : i * i) << '\n';
+  });
+
+  after([tables] {
+    std::remove((tables + "/squares.csv").c_str());
+    rmdir(tables.c_str());
+  });
+
+  it.table("should square every value", ut::Table::csv(tables + "/squares.csv"), [](const ut::Row& row) {
+    auto value = row["value"].integer();
+    ut_assert_eq(row["square"].integer(), value * value, "of", value);
+  });
+
+  // many generated cases, spread over --jobs threads
+  it.property("should reverse back to the original", Gen::vector(Gen::integer(-100, 100)), [](const std::vector<int>& values) {
+    auto reversed = values;
+    std::reverse(reversed.begin(), reversed.end());
+    std::reverse(reversed.begin(), reversed.end());
+    return reversed == values;
+  });
+
+  // the first falsifying case is shrunk to a minimal counterexample
+  it.property("should keep sums small", Gen::any<std::vector<std::uint16_t>>(), [](const std::vector<std::uint16_t>& values) {
+    std::size_t sum = 0;
+    for (auto v : values)
+      sum += v;
+    ut_assert_lt(sum, 1000u, "for", values.size(), "values");
+  });
+
+  it("should pass assertions without allocating", [] {
+    ut_assert_max_allocations(0, {
+      for (int i = 0; i < 1000; ++i)
+        ut_assert_eq(i, i, "never formatted");
+    });
+  });
+
   describe(tests)
     it("should throw an uncaught exception", [] {
       ut_assert(1 == 2, "1 does not equal 2");
@@ -0,0 +1,59 @@
+#include <uber_test.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include <malloc.h>
+
+using namespace ut;
+
+// measures what registering a large tree costs at startup: suites of tests
+// registered the way the suite and it macros do, timed and with the heap
+// growth they cause, e.g. startup 1000 100 for 100k tests; top level suites
+// defer their initializers, so most of the cost shows up when planning
+int main(int argc, char* argv[]) {
+  std::size_t suites = (argc > 1) ? std::strtoul(argv[1], nullptr, 10) : 1000;
+  std::size_t tests = (argc > 2) ? std::strtoul(argv[2], nullptr, 10) : 100;
+
+  // generated up front, so only registration is measured
+  std::vector<std::string> suite_names;
+  std::vector<std::string> test_names;
+  for (std::size_t i = 0; i < suites; ++i)
+    suite_names.push_back("generated suite " + std::to_string(i));
+  for (std::size_t i = 0; i < tests; ++i)
+    test_names.push_back("should handle generated case number " + std::to_string(i));
+
+  auto heap = mallinfo2().uordblks;
+  timer t;
+  t.start();
+  for (const auto& name : suite_names) {
+    Registry::add(parent(), name, [&](parent_name_getter, ActionAccumulator&, ActionAccumulator&, ActionAccumulator&, ActionAccumulator&, TestAccumulator& it) {
+      for (const auto& test : test_names)
+        it(test, [] {});
+    });
+  }
+  t.stop();
+  heap = mallinfo2().uordblks - heap;
+
+  auto total = suites * tests;
+  std::printf("registered %zu tests in %zu suites\n", total, suites);
+  std::printf("time: %.3f ms, %.1f ns per test\n", t.nanoseconds() / 1e6, t.nanoseconds() / static_cast<double>(total));
+  std::printf("heap: %.1f MB, %.1f bytes per test\n", heap / 1048576.0, heap / static_cast<double>(total));
+
+  // a run selecting a single suite only initializes that one
+  t.start();
+  Registry::get("root")->plan(Filter(suite_names.front()));
+  t.stop();
+  std::printf("plan one suite: %.3f ms\n", t.nanoseconds() / 1e6);
+
+  // selecting every test runs the remaining initializers and walks the whole tree
+  heap = mallinfo2().uordblks;
+  t.start();
+  Registry::get("root")->plan(Filter());
+  t.stop();
+  heap = mallinfo2().uordblks - heap;
+  std::printf("plan all: %.3f ms, %.1f ns per test\n", t.nanoseconds() / 1e6, t.nanoseconds() / static_cast<double>(total));
+  std::printf("heap: %.1f MB, %.1f bytes per test\n", heap / 1048576.0, heap / static_cast<double>(total));
+}